@@ -1,7 +1,120 @@
+#define _GNU_SOURCE // CPU affinity
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <float.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <sched.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+// ==================== SC arena ====================
+// Bump allocator owning every string and payload copy of a memory context.
+// Blocks are kept across sc_arena_reset() and reused by later allocations.
+typedef struct sc_arena_block {
+    struct sc_arena_block* next;
+    size_t size;
+    size_t used;
+    _Alignas(16) unsigned char data[];
+} sc_arena_block;
+
+typedef struct {
+    sc_arena_block* first;
+    sc_arena_block* current;
+    size_t block_size;
+} sc_arena;
+
+#define SC_ARENA_DEFAULT_BLOCK_SIZE (64 * 1024)
+
+void sc_arena_init(sc_arena* arena, size_t block_size) {
+    arena->first = NULL;
+    arena->current = NULL;
+    arena->block_size = block_size ? block_size : SC_ARENA_DEFAULT_BLOCK_SIZE;
+}
+
+static sc_arena_block* sc_arena_new_block(size_t size) {
+    sc_arena_block* block = malloc(sizeof(sc_arena_block) + size);
+    if (block == NULL) {
+        fprintf(stderr, "SC arena out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+    return block;
+}
+
+// align must be a power of two no larger than 16
+void* sc_arena_alloc(sc_arena* arena, size_t size, size_t align) {
+    sc_arena_block* block = arena->current;
+    while (block != NULL) {
+        size_t offset = (block->used + align - 1) & ~(align - 1);
+        if (offset + size <= block->size) {
+            block->used = offset + size;
+            arena->current = block;
+            return block->data + offset;
+        }
+        // Blocks after current were emptied by a reset; try the next one
+        block = block->next;
+        if (block != NULL) {
+            block->used = 0;
+        }
+    }
+
+    size_t block_size = size > arena->block_size ? size : arena->block_size;
+    block = sc_arena_new_block(block_size);
+    if (arena->current == NULL) {
+        arena->first = block;
+    } else {
+        // Keep the reusable tail of the chain behind the new block
+        sc_arena_block* last = arena->current;
+        while (last->next != NULL) {
+            last = last->next;
+        }
+        last->next = block;
+    }
+    arena->current = block;
+    block->used = size;
+    return block->data;
+}
+
+char* sc_arena_strdup(sc_arena* arena, const char* str) {
+    size_t len = strlen(str) + 1;
+    char* copy = sc_arena_alloc(arena, len, 1);
+    memcpy(copy, str, len);
+    return copy;
+}
+
+// Releases every allocation at once; the blocks stay around for reuse
+void sc_arena_reset(sc_arena* arena) {
+    arena->current = arena->first;
+    if (arena->first != NULL) {
+        arena->first->used = 0;
+    }
+}
+
+void sc_arena_destroy(sc_arena* arena) {
+    sc_arena_block* block = arena->first;
+    while (block != NULL) {
+        sc_arena_block* next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->first = arena->current = NULL;
+}
 
 // ==================== SClang-like structures ====================
 typedef enum {
@@ -9,159 +122,5832 @@ typedef enum {
     SC_RESULT_ERROR
 } sc_result;
 
-typedef struct {
-    char* addr;
-    void* data;
-    char* type;
-} sc_memory_entry;
+// Outcome of a typed lookup
+typedef enum {
+    SC_GET_OK,
+    SC_GET_EMPTY,         // nothing stored under the address
+    SC_GET_TYPE_MISMATCH  // a value of another type is stored
+} sc_get_status;
+
+// Stable integer handle of an SC element (1-based, 0 is never a valid element)
+typedef uint32_t sc_addr;
+#define SC_ADDR_EMPTY 0
+
+// Interned element type; 0 means "no value stored yet"
+typedef uint16_t sc_type_id;
+#define SC_TYPE_NONE 0
+#define SC_TYPE_MAX 64
+
+// Payloads up to this size live inside the entry itself (a triangle is 48 bytes)
+#define SC_INLINE_PAYLOAD_SIZE 48
+
+// Every entry owns a copy of its payload: small ones inline, larger ones in
+// an arena block that is reused while the value fits.
+typedef struct {
+    char* addr;        // owned by the context arena, NULL for a released handle
+    uint64_t version;  // bumped whenever the value actually changes
+    uint32_t hash;     // address hash; links the free list while released
+    uint32_t size;     // payload size in bytes
+    sc_type_id type;
+    union {
+        unsigned char bytes[SC_INLINE_PAYLOAD_SIZE];
+        struct {
+            void* data;
+            size_t capacity;
+        } external;
+        double align_double; // keeps inline payloads aligned for doubles
+    } payload;
+} sc_memory_entry;
+
+// Open-addressing index slot: entry == 0 is empty, SC_INDEX_TOMBSTONE marks a
+// removed element, anything else is the sc_addr of the element.
+typedef struct {
+    uint32_t hash;
+    uint32_t entry;
+} sc_index_slot;
+
+#define SC_INDEX_TOMBSTONE UINT32_MAX
+#define SC_INDEX_MIN_CAPACITY 16
+
+typedef struct {
+    sc_memory_entry* entries; // entries[addr - 1]
+    size_t size;              // handles ever issued, including released ones
+    size_t capacity;
+    size_t live;
+    sc_addr free_head;        // most recently released handle, reused first
+    sc_index_slot* index;
+    size_t index_capacity;    // always a power of two
+    size_t index_used;        // live slots + tombstones
+    sc_arena arena;           // addr strings and payload copies
+    struct sc_event_queue* events; // subscriptions and queued activations, NULL until the first subscribe
+    struct sc_agent_state* agents; // registry bindings and last-run versions, see sc_agent_registry_bindings
+    const struct sc_snapshot* snapshot; // read-only backing store, see sc_memory_attach_snapshot
+    struct sc_wal* wal;                 // mutation log, see sc_memory_attach_wal
+} sc_memory_context;
+
+// ==================== SC types ====================
+// The registry is process-wide and not locked: register every type before
+// agents start running on several threads.
+
+// Behaviour of a type, looked up by id wherever values are handled. Every
+// callback is optional; size is the value size in bytes.
+typedef struct {
+    // One-line rendering for print_sc_memory; the type name is printed without it
+    void (*print)(FILE* out, const void* value, size_t size);
+    // Snapshot encoding: writes the encoded value to dest, or only measures it
+    // when dest is NULL, and returns its size. Without one the bytes are stored.
+    size_t (*serialize)(const void* value, size_t size, void* dest);
+    // Inverse of serialize, with the same measuring convention; returns the value size
+    size_t (*deserialize)(const void* data, size_t size, void* dest);
+    // Fills a fresh element on store; memcpy without one
+    void (*copy)(void* dest, const void* src, size_t size);
+    // Whether a stored value and a new one are the same, so the store changes
+    // nothing; memcmp without one, which also compares struct padding
+    int (*equal)(const void* stored, const void* value, size_t size);
+    // Releases what a value owns before it is overwritten, removed or reset
+    void (*destroy)(void* value, size_t size);
+} sc_type_ops;
+
+typedef struct {
+    const char* name;
+    size_t size;   // payload bytes copied by sc_memory_store
+    int transient; // payload holds pointers and is left out of snapshots
+    sc_type_ops ops;
+} sc_type_info;
+
+static sc_type_info sc_types[SC_TYPE_MAX] = { { "", 0, 0, { NULL, NULL, NULL, NULL, NULL, NULL } } };
+static size_t sc_type_count = 1;
+static size_t sc_type_destroy_count; // types with a destroy callback; 0 skips the reset sweep
+
+// Returns the id of a registered type name, or SC_TYPE_NONE
+sc_type_id sc_type_find(const char* name) {
+    for (size_t i = 1; i < sc_type_count; i++) {
+        if (strcmp(sc_types[i].name, name) == 0) {
+            return (sc_type_id)i;
+        }
+    }
+    return SC_TYPE_NONE;
+}
+
+// Returns the id of a type name, registering it (with no payload) on first use
+sc_type_id sc_type_resolve(const char* name) {
+    sc_type_id found = sc_type_find(name);
+    if (found != SC_TYPE_NONE) {
+        return found;
+    }
+    if (sc_type_count >= SC_TYPE_MAX) {
+        fprintf(stderr, "Too many SC types, cannot register: %s\n", name);
+        exit(EXIT_FAILURE);
+    }
+    sc_types[sc_type_count].name = strdup(name);
+    sc_types[sc_type_count].size = 0;
+    sc_types[sc_type_count].transient = 0;
+    memset(&sc_types[sc_type_count].ops, 0, sizeof(sc_type_ops));
+    return (sc_type_id)sc_type_count++;
+}
+
+// Registers a type whose elements carry size bytes of payload
+sc_type_id sc_type_register(const char* name, size_t size) {
+    sc_type_id type = sc_type_resolve(name);
+    sc_types[type].size = size;
+    return type;
+}
+
+const char* sc_type_name(sc_type_id type) {
+    return type < sc_type_count ? sc_types[type].name : "";
+}
+
+size_t sc_type_size(sc_type_id type) {
+    return type < sc_type_count ? sc_types[type].size : 0;
+}
+
+// Marks a type whose values only make sense inside this process
+void sc_type_set_transient(sc_type_id type) {
+    sc_types[type].transient = 1;
+}
+
+int sc_type_is_transient(sc_type_id type) {
+    return type < sc_type_count && sc_types[type].transient;
+}
+
+void sc_type_set_ops(sc_type_id type, const sc_type_ops* ops) {
+    sc_type_destroy_count -= sc_types[type].ops.destroy != NULL;
+    sc_types[type].ops = *ops;
+    sc_type_destroy_count += ops->destroy != NULL;
+}
+
+// Callbacks of type; SC_TYPE_NONE (and any unknown id) has none
+static inline const sc_type_ops* sc_type_get_ops(sc_type_id type) {
+    return &sc_types[type < sc_type_count ? type : SC_TYPE_NONE].ops;
+}
+
+// ==================== SC memory ====================
+static uint32_t sc_hash_string(const char* str) {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    while (*str) {
+        hash ^= (unsigned char)*str++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static void sc_memory_index_rebuild(sc_memory_context* ctx, size_t new_capacity) {
+    free(ctx->index);
+    ctx->index = calloc(new_capacity, sizeof(sc_index_slot));
+    ctx->index_capacity = new_capacity;
+    ctx->index_used = ctx->live;
+
+    size_t mask = new_capacity - 1;
+    for (size_t i = 0; i < ctx->size; i++) {
+        if (ctx->entries[i].addr == NULL) {
+            continue;
+        }
+        size_t pos = ctx->entries[i].hash & mask;
+        while (ctx->index[pos].entry != 0) {
+            pos = (pos + 1) & mask;
+        }
+        ctx->index[pos].hash = ctx->entries[i].hash;
+        ctx->index[pos].entry = (uint32_t)(i + 1);
+    }
+}
+
+// Returns the slot holding addr, or SIZE_MAX if addr is not interned
+static size_t sc_memory_index_find(sc_memory_context* ctx, const char* addr, uint32_t hash) {
+    size_t mask = ctx->index_capacity - 1;
+    size_t pos = hash & mask;
+    for (;;) {
+        sc_index_slot* slot = &ctx->index[pos];
+        if (slot->entry == 0) {
+            return SIZE_MAX;
+        }
+        if (slot->entry != SC_INDEX_TOMBSTONE && slot->hash == hash &&
+            strcmp(ctx->entries[slot->entry - 1].addr, addr) == 0) {
+            return pos;
+        }
+        pos = (pos + 1) & mask;
+    }
+}
+
+static void sc_memory_index_insert(sc_memory_context* ctx, uint32_t hash, sc_addr handle) {
+    // Keep live + tombstone slots under 3/4; rebuild in place when it's mostly tombstones
+    if ((ctx->index_used + 1) * 4 > ctx->index_capacity * 3) {
+        size_t new_capacity = ctx->index_capacity;
+        while ((ctx->live + 1) * 2 > new_capacity) {
+            new_capacity *= 2;
+        }
+        sc_memory_index_rebuild(ctx, new_capacity);
+    }
+
+    size_t mask = ctx->index_capacity - 1;
+    size_t pos = hash & mask;
+    while (ctx->index[pos].entry != 0 && ctx->index[pos].entry != SC_INDEX_TOMBSTONE) {
+        pos = (pos + 1) & mask;
+    }
+    if (ctx->index[pos].entry == 0) {
+        ctx->index_used++;
+    }
+    ctx->index[pos].hash = hash;
+    ctx->index[pos].entry = handle;
+}
+
+void sc_memory_init(sc_memory_context* ctx, size_t initial_capacity) {
+    if (initial_capacity == 0) {
+        initial_capacity = 1;
+    }
+    ctx->entries = malloc(initial_capacity * sizeof(sc_memory_entry));
+    ctx->size = 0;
+    ctx->capacity = initial_capacity;
+    ctx->live = 0;
+    ctx->free_head = SC_ADDR_EMPTY;
+
+    size_t index_capacity = SC_INDEX_MIN_CAPACITY;
+    while (index_capacity < initial_capacity * 2) {
+        index_capacity *= 2;
+    }
+    ctx->index = calloc(index_capacity, sizeof(sc_index_slot));
+    ctx->index_capacity = index_capacity;
+    ctx->index_used = 0;
+    sc_arena_init(&ctx->arena, 0);
+    ctx->events = NULL;
+    ctx->agents = NULL;
+    ctx->snapshot = NULL;
+    ctx->wal = NULL;
+}
+
+static void sc_event_notify(sc_memory_context* ctx, sc_addr handle, sc_type_id type);
+static void sc_memory_release_values(sc_memory_context* ctx);
+static int sc_snapshot_contains(const struct sc_snapshot* snap, const char* addr, uint32_t hash);
+static void sc_snapshot_load(sc_memory_context* ctx, sc_addr handle, const char* addr, uint32_t hash);
+static void sc_wal_log_store(sc_memory_context* ctx, sc_addr handle);
+static void sc_wal_log_remove(sc_memory_context* ctx, const char* addr);
+static void sc_event_queue_reset(sc_memory_context* ctx);
+static int sc_event_subscribed(const sc_memory_context* ctx, sc_addr handle);
+static void sc_event_queue_destroy(sc_memory_context* ctx);
+
+// Drops every element and rewinds the arena; capacity is kept for the next round.
+// An attached snapshot stays attached, so its elements reappear on access.
+void sc_memory_reset(sc_memory_context* ctx) {
+    sc_memory_release_values(ctx);
+    ctx->size = ctx->live = 0;
+    ctx->free_head = SC_ADDR_EMPTY;
+    memset(ctx->index, 0, ctx->index_capacity * sizeof(sc_index_slot));
+    ctx->index_used = 0;
+    sc_arena_reset(&ctx->arena);
+    if (ctx->events != NULL) {
+        sc_event_queue_reset(ctx);
+    }
+    // Agent bindings refer to handles that no longer exist
+    free(ctx->agents);
+    ctx->agents = NULL;
+}
+
+void sc_memory_destroy(sc_memory_context* ctx) {
+    sc_memory_release_values(ctx);
+    if (ctx->events != NULL) {
+        sc_event_queue_destroy(ctx);
+    }
+    free(ctx->agents);
+    ctx->agents = NULL;
+    sc_arena_destroy(&ctx->arena);
+    free(ctx->entries);
+    free(ctx->index);
+    ctx->entries = NULL;
+    ctx->index = NULL;
+    ctx->size = ctx->capacity = ctx->live = 0;
+    ctx->free_head = SC_ADDR_EMPTY;
+    ctx->index_capacity = ctx->index_used = 0;
+    ctx->snapshot = NULL;
+    ctx->wal = NULL;
+}
+
+static sc_addr sc_memory_find_hashed(sc_memory_context* ctx, const char* addr, uint32_t hash) {
+    size_t pos = sc_memory_index_find(ctx, addr, hash);
+    return pos != SIZE_MAX ? ctx->index[pos].entry : SC_ADDR_EMPTY;
+}
+
+static sc_addr sc_memory_resolve_hashed(sc_memory_context* ctx, const char* addr, uint32_t hash);
+
+// Returns the handle of addr without interning it, or SC_ADDR_EMPTY.
+// Elements only present in the attached snapshot are loaded on the way.
+sc_addr sc_memory_find(sc_memory_context* ctx, const char* addr) {
+    uint32_t hash = sc_hash_string(addr);
+    sc_addr handle = sc_memory_find_hashed(ctx, addr, hash);
+    if (handle == SC_ADDR_EMPTY && ctx->snapshot != NULL && sc_snapshot_contains(ctx->snapshot, addr, hash)) {
+        handle = sc_memory_resolve_hashed(ctx, addr, hash);
+    }
+    return handle;
+}
+
+static sc_addr sc_memory_resolve_hashed(sc_memory_context* ctx, const char* addr, uint32_t hash) {
+    size_t pos = sc_memory_index_find(ctx, addr, hash);
+    if (pos != SIZE_MAX) {
+        return ctx->index[pos].entry;
+    }
+
+    sc_addr handle = ctx->free_head;
+    if (handle != SC_ADDR_EMPTY) {
+        // A reused handle keeps counting versions, so stale observers see a change
+        ctx->free_head = ctx->entries[handle - 1].hash;
+    } else {
+        // Resize if necessary
+        if (ctx->size >= ctx->capacity) {
+            ctx->capacity *= 2;
+            ctx->entries = realloc(ctx->entries, ctx->capacity * sizeof(sc_memory_entry));
+        }
+        handle = (sc_addr)++ctx->size;
+        ctx->entries[handle - 1].version = 0;
+    }
+
+    sc_memory_entry* entry = &ctx->entries[handle - 1];
+    entry->addr = sc_arena_strdup(&ctx->arena, addr);
+    entry->hash = hash;
+    entry->size = 0;
+    entry->type = SC_TYPE_NONE;
+    ctx->live++;
+    sc_memory_index_insert(ctx, hash, handle);
+    if (ctx->snapshot != NULL) {
+        sc_snapshot_load(ctx, handle, addr, hash);
+    }
+    return handle;
+}
+
+// Returns the handle of addr, interning it (with no value) on first use.
+// The handle stays valid until the element is removed.
+sc_addr sc_memory_resolve(sc_memory_context* ctx, const char* addr) {
+    return sc_memory_resolve_hashed(ctx, addr, sc_hash_string(addr));
+}
+
+static inline void* sc_memory_entry_data(sc_memory_entry* entry) {
+    return entry->size <= SC_INLINE_PAYLOAD_SIZE ? (void*)entry->payload.bytes : entry->payload.external.data;
+}
+
+// Runs the destroy callback of the current value, if any
+static inline void sc_memory_entry_release(sc_memory_entry* entry) {
+    const sc_type_ops* ops = sc_type_get_ops(entry->type);
+    if (ops->destroy != NULL) {
+        ops->destroy(sc_memory_entry_data(entry), entry->size);
+    }
+}
+
+static void sc_memory_release_values(sc_memory_context* ctx) {
+    for (size_t i = 0; sc_type_destroy_count > 0 && i < ctx->size; i++) {
+        sc_memory_entry_release(&ctx->entries[i]);
+    }
+}
+
+// Storage for the next size-byte value of entry; the old value must be released
+static void* sc_memory_entry_reserve(sc_memory_context* ctx, sc_memory_entry* entry, size_t size) {
+    void* dest;
+    if (size <= SC_INLINE_PAYLOAD_SIZE) {
+        dest = entry->payload.bytes;
+    } else if (entry->size > SC_INLINE_PAYLOAD_SIZE && entry->payload.external.capacity >= size) {
+        dest = entry->payload.external.data;
+    } else {
+        // The previous out-of-line block (if any) is reclaimed by the next arena reset
+        dest = sc_arena_alloc(&ctx->arena, size, 16);
+        entry->payload.external.data = dest;
+        entry->payload.external.capacity = size;
+    }
+    return dest;
+}
+
+static void sc_memory_entry_assign(sc_memory_context* ctx, sc_memory_entry* entry, const void* data, size_t size,
+                                   sc_type_id type) {
+    sc_memory_entry_release(entry);
+    void* dest = sc_memory_entry_reserve(ctx, entry, size);
+    const sc_type_ops* ops = sc_type_get_ops(type);
+    if (ops->copy != NULL) {
+        ops->copy(dest, data, size);
+    } else {
+        memcpy(dest, data, size);
+    }
+    entry->size = (uint32_t)size;
+    entry->type = type;
+    entry->version++;
+}
+
+// Stores a copy of size bytes of data; the caller's buffer can go away afterwards.
+// Storing the value an element already holds changes nothing: its version
+// stays put and no subscriber is activated.
+void sc_memory_store_copy_by_handle(sc_memory_context* ctx, sc_addr handle, const void* data, size_t size,
+                                    sc_type_id type) {
+    sc_memory_entry* entry = &ctx->entries[handle - 1];
+    if (entry->type == type && entry->size == size) {
+        const sc_type_ops* ops = sc_type_get_ops(type);
+        if (ops->equal != NULL ? ops->equal(sc_memory_entry_data(entry), data, size)
+                               : memcmp(sc_memory_entry_data(entry), data, size) == 0) {
+            return;
+        }
+    }
+
+    sc_memory_entry_assign(ctx, entry, data, size, type);
+    if (ctx->wal != NULL) {
+        sc_wal_log_store(ctx, handle);
+    }
+    if (ctx->events != NULL) {
+        sc_event_notify(ctx, handle, type);
+    }
+}
+
+// Stores a copy of one value of the given type (sc_type_size(type) bytes)
+void sc_memory_store_by_handle(sc_memory_context* ctx, sc_addr handle, const void* data, sc_type_id type) {
+    sc_memory_store_copy_by_handle(ctx, handle, data, sc_type_size(type), type);
+}
+
+// On SC_GET_OK *out addresses the value owned by the context; it stays valid
+// until the element is stored again or a new address is resolved. Otherwise
+// *out is NULL.
+sc_get_status sc_memory_try_get_by_handle(sc_memory_context* ctx, sc_addr handle, sc_type_id type, void** out) {
+    sc_memory_entry* entry = &ctx->entries[handle - 1];
+    *out = NULL;
+    if (entry->type == SC_TYPE_NONE) {
+        return SC_GET_EMPTY;
+    }
+    if (entry->type != type) {
+        return SC_GET_TYPE_MISMATCH;
+    }
+    *out = sc_memory_entry_data(entry);
+    return SC_GET_OK;
+}
+
+// Like sc_memory_try_get_by_handle, but reports a type mismatch on stderr
+// and returns NULL for it as for an empty element
+void* sc_memory_get_by_handle(sc_memory_context* ctx, sc_addr handle, sc_type_id type) {
+    void* data;
+    if (sc_memory_try_get_by_handle(ctx, handle, type, &data) == SC_GET_TYPE_MISMATCH) {
+        fprintf(stderr, "Type mismatch for SC element: %s\n", ctx->entries[handle - 1].addr);
+    }
+    return data;
+}
+
+void sc_memory_store(sc_memory_context* ctx, const char* addr, const void* data, const char* type) {
+    sc_memory_store_by_handle(ctx, sc_memory_resolve(ctx, addr), data, sc_type_resolve(type));
+}
+
+void sc_memory_store_copy(sc_memory_context* ctx, const char* addr, const void* data, size_t size,
+                          const char* type) {
+    sc_memory_store_copy_by_handle(ctx, sc_memory_resolve(ctx, addr), data, size, sc_type_resolve(type));
+}
+
+uint64_t sc_memory_version(sc_memory_context* ctx, sc_addr handle) {
+    return ctx->entries[handle - 1].version;
+}
+
+sc_get_status sc_memory_try_get(sc_memory_context* ctx, const char* addr, const char* type, void** out) {
+    sc_addr handle = sc_memory_find(ctx, addr);
+    if (handle == SC_ADDR_EMPTY) {
+        *out = NULL;
+        return SC_GET_EMPTY;
+    }
+    return sc_memory_try_get_by_handle(ctx, handle, sc_type_resolve(type), out);
+}
+
+void* sc_memory_get(sc_memory_context* ctx, const char* addr, const char* type) {
+    sc_addr handle = sc_memory_find(ctx, addr);
+    if (handle == SC_ADDR_EMPTY) {
+        return NULL;
+    }
+    return sc_memory_get_by_handle(ctx, handle, sc_type_resolve(type));
+}
+
+// Removes addr from memory and releases its handle; returns 1 if it was present.
+// An element the attached snapshot also holds keeps its handle with no value,
+// which hides the snapshot copy from lookups and later snapshot writes. So
+// does one an address subscription is bound to, so that storing addr again
+// still activates it.
+int sc_memory_remove(sc_memory_context* ctx, const char* addr) {
+    uint32_t hash = sc_hash_string(addr);
+    size_t pos = sc_memory_index_find(ctx, addr, hash);
+    if (ctx->snapshot != NULL && sc_snapshot_contains(ctx->snapshot, addr, hash)) {
+        sc_addr handle = pos != SIZE_MAX ? ctx->index[pos].entry : sc_memory_resolve_hashed(ctx, addr, hash);
+        sc_memory_entry* entry = &ctx->entries[handle - 1];
+        if (entry->type == SC_TYPE_NONE) {
+            return 0;
+        }
+        sc_memory_entry_release(entry);
+        entry->size = 0;
+        entry->type = SC_TYPE_NONE;
+        entry->version++;
+        if (ctx->wal != NULL) {
+            sc_wal_log_remove(ctx, addr);
+        }
+        return 1;
+    }
+    if (pos == SIZE_MAX) {
+        return 0;
+    }
+    sc_addr handle = ctx->index[pos].entry;
+    sc_memory_entry* entry = &ctx->entries[handle - 1];
+    if (ctx->events != NULL && sc_event_subscribed(ctx, handle)) {
+        if (entry->type == SC_TYPE_NONE) {
+            return 0;
+        }
+        sc_memory_entry_release(entry);
+        entry->size = 0;
+        entry->type = SC_TYPE_NONE;
+        entry->version++;
+        if (ctx->wal != NULL) {
+            sc_wal_log_remove(ctx, addr);
+        }
+        return 1;
+    }
+    if (ctx->wal != NULL) {
+        sc_wal_log_remove(ctx, addr);
+    }
+
+    sc_memory_entry_release(entry);
+    // The address string and payload stay in the arena until the next reset
+    ctx->index[pos].entry = SC_INDEX_TOMBSTONE;
+    entry->addr = NULL;
+    entry->size = 0;
+    entry->type = SC_TYPE_NONE;
+    entry->hash = ctx->free_head;
+    ctx->free_head = handle;
+    ctx->live--;
+    return 1;
+}
+
+// ==================== SC snapshot ====================
+// Position-independent image of a memory context, meant to be mapped rather
+// than parsed. Every reference inside the file is an offset: addresses and
+// type names point into the string table, values into the payload blob, and
+// the serialized open-addressing index (linear probing on the address hash,
+// slots hold entry number + 1) makes lookups work straight from the mapping.
+// Only the pages a lookup touches are ever read from disk.
+//
+//   header | types | entries | index | strings | payload
+//
+// Sections start on 64-byte boundaries, payloads on 16-byte ones. Files are
+// written in host byte order and rejected on a host with another one.
+#define SC_SNAPSHOT_MAGIC "SCSNAP\0"
+#define SC_SNAPSHOT_VERSION 1
+#define SC_SNAPSHOT_BYTE_ORDER 0x01020304u
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t file_size;
+    uint32_t type_count;
+    uint32_t entry_count;
+    uint32_t index_capacity; // power of two
+    uint32_t reserved;
+    uint64_t types_offset;
+    uint64_t entries_offset;
+    uint64_t index_offset;
+    uint64_t strings_offset;
+    uint64_t strings_size;
+    uint64_t payload_offset;
+    uint64_t payload_size;
+} sc_snapshot_header;
+
+typedef struct {
+    uint32_t name; // string table offset
+    uint32_t size; // sc_type_size() when written
+} sc_snapshot_type;
+
+typedef struct {
+    uint32_t addr; // string table offset
+    uint32_t hash; // sc_hash_string(addr)
+    uint32_t type; // index into the type table
+    uint32_t size;
+    uint64_t payload; // offset into the payload blob
+} sc_snapshot_entry;
+
+typedef struct sc_snapshot {
+    const unsigned char* base; // the whole mapped file
+    size_t size;
+    const sc_snapshot_header* header;
+    const sc_snapshot_type* types;
+    const sc_snapshot_entry* entries;
+    const uint32_t* index;
+    const char* strings;
+    const unsigned char* payload;
+    sc_type_id* type_ids; // type table index -> runtime id, SC_TYPE_NONE if the layouts disagree
+} sc_snapshot;
+
+static size_t sc_snapshot_align(size_t offset, size_t alignment) {
+    return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+static int sc_snapshot_section_valid(const sc_snapshot* snap, uint64_t offset, uint64_t count, size_t item) {
+    return offset % 8 == 0 && offset <= snap->size && count <= (snap->size - offset) / item;
+}
+
+// Maps path read-only; the snapshot stays usable until sc_snapshot_close
+sc_result sc_snapshot_open(sc_snapshot* snap, const char* path) {
+    memset(snap, 0, sizeof(*snap));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Cannot open SC snapshot: %s\n", path);
+        return SC_RESULT_ERROR;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(sc_snapshot_header)) {
+        fprintf(stderr, "Not an SC snapshot: %s\n", path);
+        close(fd);
+        return SC_RESULT_ERROR;
+    }
+    void* base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        fprintf(stderr, "Cannot map SC snapshot: %s\n", path);
+        return SC_RESULT_ERROR;
+    }
+    snap->base = base;
+    snap->size = (size_t)st.st_size;
+    snap->header = base;
+
+    const sc_snapshot_header* h = snap->header;
+    int valid = memcmp(h->magic, SC_SNAPSHOT_MAGIC, sizeof(h->magic)) == 0 && h->version == SC_SNAPSHOT_VERSION &&
+                h->byte_order == SC_SNAPSHOT_BYTE_ORDER && h->file_size == snap->size &&
+                h->index_capacity != 0 && (h->index_capacity & (h->index_capacity - 1)) == 0 &&
+                sc_snapshot_section_valid(snap, h->types_offset, h->type_count, sizeof(sc_snapshot_type)) &&
+                sc_snapshot_section_valid(snap, h->entries_offset, h->entry_count, sizeof(sc_snapshot_entry)) &&
+                sc_snapshot_section_valid(snap, h->index_offset, h->index_capacity, sizeof(uint32_t)) &&
+                sc_snapshot_section_valid(snap, h->strings_offset, h->strings_size, 1) &&
+                sc_snapshot_section_valid(snap, h->payload_offset, h->payload_size, 1) && h->strings_size > 0 &&
+                snap->base[h->strings_offset + h->strings_size - 1] == '\0';
+    if (!valid) {
+        fprintf(stderr, "Corrupt or incompatible SC snapshot: %s\n", path);
+        munmap(base, snap->size);
+        memset(snap, 0, sizeof(*snap));
+        return SC_RESULT_ERROR;
+    }
+
+    snap->types = (const sc_snapshot_type*)(snap->base + h->types_offset);
+    snap->entries = (const sc_snapshot_entry*)(snap->base + h->entries_offset);
+    snap->index = (const uint32_t*)(snap->base + h->index_offset);
+    snap->strings = (const char*)(snap->base + h->strings_offset);
+    snap->payload = snap->base + h->payload_offset;
+
+    // Types are matched by name against the registry; elements of types this
+    // process has not registered stay invisible
+    snap->type_ids = calloc(h->type_count ? h->type_count : 1, sizeof(sc_type_id));
+    for (uint32_t i = 0; i < h->type_count; i++) {
+        if (snap->types[i].name >= h->strings_size) {
+            continue;
+        }
+        sc_type_id type = sc_type_find(snap->strings + snap->types[i].name);
+        size_t size = sc_type_size(type);
+        if (type != SC_TYPE_NONE && !sc_type_is_transient(type) && (size == 0 || size == snap->types[i].size)) {
+            snap->type_ids[i] = type;
+        }
+    }
+    return SC_RESULT_OK;
+}
+
+void sc_snapshot_close(sc_snapshot* snap) {
+    if (snap->base != NULL) {
+        munmap((void*)snap->base, snap->size);
+    }
+    free(snap->type_ids);
+    memset(snap, 0, sizeof(*snap));
+}
+
+// Returns the entry of addr if it is present and well-formed
+static const sc_snapshot_entry* sc_snapshot_find(const sc_snapshot* snap, const char* addr, uint32_t hash) {
+    const sc_snapshot_header* h = snap->header;
+    size_t mask = h->index_capacity - 1;
+    size_t pos = hash & mask;
+    for (size_t probes = 0; probes < h->index_capacity; probes++) {
+        uint32_t slot = snap->index[pos];
+        if (slot == 0 || slot > h->entry_count) {
+            return NULL;
+        }
+        const sc_snapshot_entry* entry = &snap->entries[slot - 1];
+        if (entry->hash == hash && entry->addr < h->strings_size && strcmp(snap->strings + entry->addr, addr) == 0) {
+            int valid = entry->type < h->type_count && snap->type_ids[entry->type] != SC_TYPE_NONE &&
+                        entry->payload <= h->payload_size && entry->size <= h->payload_size - entry->payload;
+            return valid ? entry : NULL;
+        }
+        pos = (pos + 1) & mask;
+    }
+    return NULL;
+}
+
+static int sc_snapshot_contains(const sc_snapshot* snap, const char* addr, uint32_t hash) {
+    return sc_snapshot_find(snap, addr, hash) != NULL;
+}
+
+// Zero-copy read: the value inside the mapping, or NULL if addr is missing
+// or holds another type. size (optional) receives the payload size. Values of
+// types with a deserializer are stored encoded; load those through a context.
+const void* sc_snapshot_get(const sc_snapshot* snap, const char* addr, const char* type, size_t* size) {
+    const sc_snapshot_entry* entry = sc_snapshot_find(snap, addr, sc_hash_string(addr));
+    if (entry == NULL || snap->type_ids[entry->type] != sc_type_resolve(type) ||
+        sc_type_get_ops(snap->type_ids[entry->type])->deserialize != NULL) {
+        return NULL;
+    }
+    if (size != NULL) {
+        *size = entry->size;
+    }
+    return snap->payload + entry->payload;
+}
+
+// Copies the snapshot value of a freshly interned element into ctx. This is
+// a load, not a store: subscribers are not activated.
+static void sc_snapshot_load(sc_memory_context* ctx, sc_addr handle, const char* addr, uint32_t hash) {
+    const sc_snapshot* snap = ctx->snapshot;
+    const sc_snapshot_entry* entry = sc_snapshot_find(snap, addr, hash);
+    if (entry == NULL) {
+        return;
+    }
+    sc_type_id type = snap->type_ids[entry->type];
+    const void* data = snap->payload + entry->payload;
+    const sc_type_ops* ops = sc_type_get_ops(type);
+    if (ops->deserialize == NULL) {
+        sc_memory_entry_assign(ctx, &ctx->entries[handle - 1], data, entry->size, type);
+        return;
+    }
+    sc_memory_entry* target = &ctx->entries[handle - 1];
+    size_t size = ops->deserialize(data, entry->size, NULL);
+    ops->deserialize(data, entry->size, sc_memory_entry_reserve(ctx, target, size));
+    target->size = (uint32_t)size;
+    target->type = type;
+    target->version++;
+}
+
+// Backs ctx with snap: elements missing from ctx are loaded from the snapshot
+// the first time they are resolved or looked up. Values in ctx always win;
+// snap must outlive the attachment. NULL detaches.
+void sc_memory_attach_snapshot(sc_memory_context* ctx, const sc_snapshot* snap) {
+    ctx->snapshot = snap;
+}
+
+typedef struct {
+    const char* addr;
+    uint32_t hash;
+    sc_type_id type;
+    uint32_t size;         // of data
+    const void* data;
+    int encoded;           // data comes from a snapshot and is stored as is
+    uint32_t stored_size;  // in the new snapshot
+} sc_snapshot_record;
+
+// Flushes the directory entry of path (a rename into it) to disk
+static int sc_fsync_parent(const char* path) {
+    const char* slash = strrchr(path, '/');
+    char* dir = slash == NULL ? strdup(".") : slash == path ? strdup("/") : strndup(path, (size_t)(slash - path));
+    int fd = open(dir, O_RDONLY | O_DIRECTORY);
+    free(dir);
+    if (fd < 0) {
+        return -1;
+    }
+    int result = fsync(fd);
+    close(fd);
+    return result;
+}
+
+// Writes every valued, non-transient element of ctx, plus the elements of an
+// attached snapshot that were never loaded, so the result is complete. The
+// file and the rename that installs it are on disk when this returns OK.
+sc_result sc_snapshot_write(sc_memory_context* ctx, const char* path) {
+    const sc_snapshot* old = ctx->snapshot;
+    size_t max_records = ctx->size + (old != NULL ? old->header->entry_count : 0);
+    sc_snapshot_record* records = malloc((max_records ? max_records : 1) * sizeof(sc_snapshot_record));
+    size_t count = 0;
+    for (size_t i = 0; i < ctx->size; i++) {
+        sc_memory_entry* entry = &ctx->entries[i];
+        if (entry->addr != NULL && entry->type != SC_TYPE_NONE && !sc_type_is_transient(entry->type)) {
+            records[count++] = (sc_snapshot_record){ entry->addr, entry->hash, entry->type, entry->size,
+                                                     sc_memory_entry_data(entry), 0, 0 };
+        }
+    }
+    for (uint32_t i = 0; old != NULL && i < old->header->entry_count; i++) {
+        const sc_snapshot_entry* entry = &old->entries[i];
+        if (entry->addr >= old->header->strings_size) {
+            continue;
+        }
+        const char* addr = old->strings + entry->addr;
+        if (sc_snapshot_find(old, addr, entry->hash) == entry &&
+            sc_memory_find_hashed(ctx, addr, entry->hash) == SC_ADDR_EMPTY) {
+            records[count++] = (sc_snapshot_record){ addr, entry->hash, old->type_ids[entry->type], entry->size,
+                                                     old->payload + entry->payload, 1, 0 };
+        }
+    }
+
+    // Sizes first: type table, strings and payload blob
+    uint32_t type_index[SC_TYPE_MAX];
+    sc_type_id types[SC_TYPE_MAX];
+    uint32_t type_count = 0;
+    memset(type_index, 0xff, sizeof(type_index));
+    size_t strings_size = 1; // offset 0 is the empty string
+    size_t payload_size = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (type_index[records[i].type] == UINT32_MAX) {
+            type_index[records[i].type] = type_count;
+            types[type_count++] = records[i].type;
+            strings_size += strlen(sc_type_name(records[i].type)) + 1;
+        }
+        strings_size += strlen(records[i].addr) + 1;
+        const sc_type_ops* ops = sc_type_get_ops(records[i].type);
+        records[i].stored_size = records[i].encoded || ops->serialize == NULL
+                                     ? records[i].size
+                                     : (uint32_t)ops->serialize(records[i].data, records[i].size, NULL);
+        payload_size = sc_snapshot_align(payload_size, 16) + records[i].stored_size;
+    }
+    if (strings_size > UINT32_MAX || count >= UINT32_MAX / 2) {
+        fprintf(stderr, "SC memory too large for a snapshot: %s\n", path);
+        free(records);
+        return SC_RESULT_ERROR;
+    }
+    uint32_t index_capacity = SC_INDEX_MIN_CAPACITY;
+    while (index_capacity < count * 2) {
+        index_capacity *= 2;
+    }
+
+    sc_snapshot_header header = { SC_SNAPSHOT_MAGIC, SC_SNAPSHOT_VERSION, SC_SNAPSHOT_BYTE_ORDER, 0,
+                                  type_count, (uint32_t)count, index_capacity, 0, 0, 0, 0, 0, 0, 0, 0 };
+    header.types_offset = sc_snapshot_align(sizeof(header), 64);
+    header.entries_offset = sc_snapshot_align(header.types_offset + type_count * sizeof(sc_snapshot_type), 64);
+    header.index_offset = sc_snapshot_align(header.entries_offset + count * sizeof(sc_snapshot_entry), 64);
+    header.strings_offset = sc_snapshot_align(header.index_offset + index_capacity * sizeof(uint32_t), 64);
+    header.strings_size = strings_size;
+    header.payload_offset = sc_snapshot_align(header.strings_offset + strings_size, 64);
+    header.payload_size = payload_size;
+    header.file_size = header.payload_offset + payload_size;
+
+    // The image is built in memory and written in one go
+    unsigned char* image = calloc(1, header.file_size);
+    memcpy(image, &header, sizeof(header));
+    sc_snapshot_type* out_types = (sc_snapshot_type*)(image + header.types_offset);
+    sc_snapshot_entry* out_entries = (sc_snapshot_entry*)(image + header.entries_offset);
+    uint32_t* out_index = (uint32_t*)(image + header.index_offset);
+    char* out_strings = (char*)(image + header.strings_offset);
+    size_t string_pos = 1;
+    for (uint32_t t = 0; t < type_count; t++) {
+        size_t len = strlen(sc_type_name(types[t])) + 1;
+        memcpy(out_strings + string_pos, sc_type_name(types[t]), len);
+        out_types[t].name = (uint32_t)string_pos;
+        out_types[t].size = (uint32_t)sc_type_size(types[t]);
+        string_pos += len;
+    }
+    size_t payload_pos = 0;
+    for (size_t i = 0; i < count; i++) {
+        size_t len = strlen(records[i].addr) + 1;
+        memcpy(out_strings + string_pos, records[i].addr, len);
+        payload_pos = sc_snapshot_align(payload_pos, 16);
+        const sc_type_ops* ops = sc_type_get_ops(records[i].type);
+        if (records[i].encoded || ops->serialize == NULL) {
+            memcpy(image + header.payload_offset + payload_pos, records[i].data, records[i].size);
+        } else {
+            ops->serialize(records[i].data, records[i].size, image + header.payload_offset + payload_pos);
+        }
+        out_entries[i] = (sc_snapshot_entry){ (uint32_t)string_pos, records[i].hash, type_index[records[i].type],
+                                              records[i].stored_size, payload_pos };
+        string_pos += len;
+        payload_pos += records[i].stored_size;
+
+        size_t pos = records[i].hash & (index_capacity - 1);
+        while (out_index[pos] != 0) {
+            pos = (pos + 1) & (index_capacity - 1);
+        }
+        out_index[pos] = (uint32_t)(i + 1);
+    }
+    free(records);
+
+    // Written aside and renamed over path, so a mapping of the old file
+    // (possibly the attached snapshot itself) stays intact
+    size_t path_len = strlen(path);
+    char* tmp_path = malloc(path_len + 5);
+    memcpy(tmp_path, path, path_len);
+    memcpy(tmp_path + path_len, ".tmp", 5);
+    FILE* file = fopen(tmp_path, "wb");
+    int written = file != NULL && fwrite(image, 1, header.file_size, file) == header.file_size &&
+                  fflush(file) == 0 && fsync(fileno(file)) == 0;
+    if (file != NULL && fclose(file) != 0) {
+        written = 0;
+    }
+    written = written && rename(tmp_path, path) == 0 && sc_fsync_parent(path) == 0;
+    if (!written) {
+        remove(tmp_path);
+    }
+    free(tmp_path);
+    free(image);
+    if (!written) {
+        fprintf(stderr, "Cannot write SC snapshot: %s\n", path);
+        return SC_RESULT_ERROR;
+    }
+    return SC_RESULT_OK;
+}
+
+#define SC_SNAPSHOT_SELFTEST_KEYS 1000
+
+// A uint64_t stored as a LEB128 varint, to exercise the type callbacks
+static size_t sc_snapshot_selftest_destroyed;
+
+static size_t sc_varint_serialize(const void* value, size_t size, void* dest) {
+    (void)size;
+    uint64_t v;
+    memcpy(&v, value, sizeof(v));
+    size_t n = 0;
+    do {
+        if (dest != NULL) {
+            ((unsigned char*)dest)[n] = (unsigned char)((v & 0x7f) | (v > 0x7f ? 0x80 : 0));
+        }
+        n++;
+        v >>= 7;
+    } while (v != 0);
+    return n;
+}
+
+static size_t sc_varint_deserialize(const void* data, size_t size, void* dest) {
+    uint64_t v = 0;
+    for (size_t n = 0; n < size && n < 10; n++) {
+        v |= (uint64_t)(((const unsigned char*)data)[n] & 0x7f) << (7 * n);
+    }
+    if (dest != NULL) {
+        memcpy(dest, &v, sizeof(v));
+    }
+    return sizeof(v);
+}
+
+static void sc_varint_destroy(void* value, size_t size) {
+    (void)value;
+    (void)size;
+    sc_snapshot_selftest_destroyed++;
+}
+
+// Writes a context, reopens it as a backing snapshot, changes one element
+// and rewrites the file over the still-attached mapping
+int sc_snapshot_selftest(void) {
+    sc_type_register("int", sizeof(int));
+    sc_type_id varint_type = sc_type_register("selftest_varint", sizeof(uint64_t));
+    sc_type_set_ops(varint_type, &(sc_type_ops){ .serialize = sc_varint_serialize,
+                                                 .deserialize = sc_varint_deserialize,
+                                                 .destroy = sc_varint_destroy });
+    char path[] = "/tmp/sc_snapshot_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        printf("%-8s %s\n", "snapshot", "SKIPPED (no temporary file)");
+        return 1;
+    }
+    close(fd);
+
+    sc_memory_context ctx;
+    sc_memory_init(&ctx, 16);
+    char addr[32];
+    for (int k = 0; k < SC_SNAPSHOT_SELFTEST_KEYS; k++) {
+        snprintf(addr, sizeof(addr), "key%d", k);
+        sc_memory_store(&ctx, addr, &k, "int");
+    }
+    char blob[100];
+    for (size_t i = 0; i < sizeof(blob); i++) {
+        blob[i] = (char)i;
+    }
+    sc_memory_store_copy(&ctx, "blob", blob, sizeof(blob), "blob"); // registered here with no fixed size
+    sc_memory_resolve(&ctx, "no_value");
+    uint64_t varint = 1;
+    sc_memory_store(&ctx, "varint", &varint, "selftest_varint");
+    varint = 300; // two bytes encoded
+    sc_memory_store(&ctx, "varint", &varint, "selftest_varint");
+    int errors = sc_snapshot_write(&ctx, path) != SC_RESULT_OK;
+    sc_memory_destroy(&ctx);
+    errors += sc_snapshot_selftest_destroyed != 2; // overwritten, then dropped
+
+    sc_snapshot snap;
+    errors += sc_snapshot_open(&snap, path) != SC_RESULT_OK;
+    sc_memory_init(&ctx, 16);
+    sc_memory_attach_snapshot(&ctx, &snap);
+    int changed = -1;
+    if (errors == 0) {
+        const int* direct = sc_snapshot_get(&snap, "key7", "int", NULL);
+        errors += direct == NULL || *direct != 7;
+        errors += sc_snapshot_get(&snap, "key7", "blob", NULL) != NULL;
+        errors += sc_snapshot_get(&snap, "no_value", "int", NULL) != NULL;
+        int* loaded = sc_memory_get(&ctx, "key500", "int");
+        errors += loaded == NULL || *loaded != 500;
+        errors += sc_snapshot_get(&snap, "varint", "selftest_varint", NULL) != NULL; // stored encoded
+        uint64_t* decoded = sc_memory_get(&ctx, "varint", "selftest_varint");
+        errors += decoded == NULL || *decoded != varint;
+        sc_memory_store(&ctx, "key1", &changed, "int");
+        errors += sc_snapshot_write(&ctx, path) != SC_RESULT_OK;
+    }
+    sc_memory_destroy(&ctx);
+    sc_snapshot_close(&snap);
+
+    uint32_t entry_count = 0;
+    errors += sc_snapshot_open(&snap, path) != SC_RESULT_OK;
+    if (errors == 0) {
+        entry_count = snap.header->entry_count;
+        for (int k = 0; k < SC_SNAPSHOT_SELFTEST_KEYS; k++) {
+            snprintf(addr, sizeof(addr), "key%d", k);
+            const int* value = sc_snapshot_get(&snap, addr, "int", NULL);
+            errors += value == NULL || *value != (k == 1 ? changed : k);
+        }
+        size_t size = 0;
+        const char* loaded = sc_snapshot_get(&snap, "blob", "blob", &size);
+        errors += loaded == NULL || size != sizeof(blob) || memcmp(loaded, blob, sizeof(blob)) != 0;
+        errors += entry_count != SC_SNAPSHOT_SELFTEST_KEYS + 2;
+    }
+    sc_snapshot_close(&snap);
+    unlink(path);
+
+    printf("%-8s %s (%u elements written, reopened and rewritten)\n", "snapshot", errors == 0 ? "ok" : "MISMATCH",
+           entry_count);
+    return errors == 0;
+}
+
+// ==================== SC write-ahead log ====================
+// Append-only log of SC memory mutations for durability between snapshots.
+// Every store that changes a value (including sc_memory_touch) and every
+// remove appends one checksummed record to an in-memory group. The group is
+// written and fdatasync'ed once it reaches group_bytes or once a record is
+// appended more than group_interval_ms after the last sync; sc_wal_commit
+// forces it. A crash loses at most the uncommitted group.
+//
+// Recovery: open the last snapshot, attach it, sc_wal_replay the log into the
+// context, then attach the log again. sc_wal_checkpoint writes a new
+// snapshot and empties the log.
+//
+// Record: crc32 | body size | body, all host byte order; the crc covers the body.
+// Body: kind (u16) | addr length (u16) | type name length (u16) | reserved (u16)
+//       | value size (u32) | addr | type name | value
+#define SC_WAL_STORE 1
+#define SC_WAL_REMOVE 2
+#define SC_WAL_RECORD_HEADER 8
+#define SC_WAL_BODY_HEADER 12
+
+typedef struct sc_wal {
+    int fd;
+    unsigned char* buffer; // the current group
+    size_t used;
+    size_t capacity;
+    size_t group_bytes;
+    uint64_t group_interval_ns;
+    uint64_t last_sync_ns;
+    uint64_t records;
+    uint64_t commits;
+    int failed; // a write or sync failed; the log is no longer trustworthy
+} sc_wal;
+
+static uint32_t sc_crc32_table[256];
+
+// CRC-32 (IEEE, reflected), table-driven
+static uint32_t sc_crc32(const unsigned char* data, size_t size) {
+    if (sc_crc32_table[1] == 0) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t crc = i;
+            for (int k = 0; k < 8; k++) {
+                crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+            }
+            sc_crc32_table[i] = crc;
+        }
+    }
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < size; i++) {
+        crc = (crc >> 8) ^ sc_crc32_table[(crc ^ data[i]) & 0xFF];
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+// Monotonic clock in nanoseconds
+static uint64_t sc_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Opens (or creates) the log at path for appending. Replay it first: records
+// appended after a torn tail would never be replayed.
+sc_result sc_wal_open(sc_wal* wal, const char* path, size_t group_bytes, unsigned group_interval_ms) {
+    memset(wal, 0, sizeof(*wal));
+    wal->fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (wal->fd < 0) {
+        fprintf(stderr, "Cannot open SC write-ahead log: %s\n", path);
+        return SC_RESULT_ERROR;
+    }
+    wal->group_bytes = group_bytes ? group_bytes : 64 * 1024;
+    wal->capacity = wal->group_bytes;
+    wal->buffer = malloc(wal->capacity);
+    wal->group_interval_ns = (uint64_t)group_interval_ms * 1000000ull;
+    wal->last_sync_ns = sc_now_ns();
+    return SC_RESULT_OK;
+}
+
+// Writes and syncs the current group
+sc_result sc_wal_commit(sc_wal* wal) {
+    size_t written = 0;
+    while (written < wal->used) {
+        ssize_t n = write(wal->fd, wal->buffer + written, wal->used - written);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        written += (size_t)n;
+    }
+    int ok = written == wal->used && fdatasync(wal->fd) == 0;
+    wal->used = 0;
+    wal->last_sync_ns = sc_now_ns();
+    wal->commits++;
+    if (!ok && !wal->failed) {
+        fprintf(stderr, "SC write-ahead log commit failed\n");
+    }
+    wal->failed |= !ok;
+    return ok ? SC_RESULT_OK : SC_RESULT_ERROR;
+}
+
+void sc_wal_close(sc_wal* wal) {
+    if (wal->fd >= 0) {
+        sc_wal_commit(wal);
+        close(wal->fd);
+    }
+    free(wal->buffer);
+    memset(wal, 0, sizeof(*wal));
+    wal->fd = -1;
+}
+
+static void sc_wal_append(sc_wal* wal, uint16_t kind, const char* addr, const char* type, const void* value,
+                          uint32_t value_size) {
+    size_t addr_len = strlen(addr);
+    size_t type_len = strlen(type);
+    if (addr_len > UINT16_MAX || type_len > UINT16_MAX) {
+        fprintf(stderr, "SC address too long for the write-ahead log: %s\n", addr);
+        exit(EXIT_FAILURE);
+    }
+    size_t body_size = SC_WAL_BODY_HEADER + addr_len + type_len + value_size;
+    size_t record_size = SC_WAL_RECORD_HEADER + body_size;
+    if (wal->used + record_size > wal->capacity) {
+        if (wal->used > 0) {
+            sc_wal_commit(wal);
+        }
+        if (record_size > wal->capacity) {
+            wal->capacity = record_size;
+            wal->buffer = realloc(wal->buffer, wal->capacity);
+        }
+    }
+
+    unsigned char* record = wal->buffer + wal->used;
+    unsigned char* body = record + SC_WAL_RECORD_HEADER;
+    uint16_t lengths[4] = { kind, (uint16_t)addr_len, (uint16_t)type_len, 0 };
+    memcpy(body, lengths, sizeof(lengths));
+    memcpy(body + 8, &value_size, sizeof(value_size));
+    memcpy(body + SC_WAL_BODY_HEADER, addr, addr_len);
+    memcpy(body + SC_WAL_BODY_HEADER + addr_len, type, type_len);
+    if (value_size > 0) {
+        memcpy(body + SC_WAL_BODY_HEADER + addr_len + type_len, value, value_size);
+    }
+    uint32_t header[2] = { sc_crc32(body, body_size), (uint32_t)body_size };
+    memcpy(record, header, sizeof(header));
+    wal->used += record_size;
+    wal->records++;
+
+    if (wal->used >= wal->group_bytes || sc_now_ns() - wal->last_sync_ns >= wal->group_interval_ns) {
+        sc_wal_commit(wal);
+    }
+}
+
+static void sc_wal_log_store(sc_memory_context* ctx, sc_addr handle) {
+    sc_memory_entry* entry = &ctx->entries[handle - 1];
+    if (!sc_type_is_transient(entry->type)) {
+        sc_wal_append(ctx->wal, SC_WAL_STORE, entry->addr, sc_type_name(entry->type), sc_memory_entry_data(entry),
+                      entry->size);
+    }
+}
+
+static void sc_wal_log_remove(sc_memory_context* ctx, const char* addr) {
+    sc_wal_append(ctx->wal, SC_WAL_REMOVE, addr, "", NULL, 0);
+}
+
+// Logs every later mutation of ctx to wal; NULL detaches. sc_memory_reset is
+// not logged.
+void sc_memory_attach_wal(sc_memory_context* ctx, sc_wal* wal) {
+    ctx->wal = wal;
+}
+
+// Applies the records of the log at path to ctx in order and returns how many
+// were applied. Replay stops at the first truncated or corrupt record, and
+// the file is cut back to the records before it. A missing log replays nothing.
+size_t sc_wal_replay(sc_memory_context* ctx, const char* path) {
+    int fd = open(path, O_RDWR);
+    if (fd < 0) {
+        return 0;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+    size_t size = (size_t)st.st_size;
+    unsigned char* log = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (log == MAP_FAILED) {
+        fprintf(stderr, "Cannot map SC write-ahead log: %s\n", path);
+        close(fd);
+        return 0;
+    }
+    madvise(log, size, MADV_SEQUENTIAL);
+
+    sc_wal* wal = ctx->wal;
+    ctx->wal = NULL; // replayed records are already in the log
+    size_t applied = 0;
+    size_t pos = 0;
+    char addr[UINT16_MAX + 1];
+    char type[UINT16_MAX + 1];
+    while (size - pos >= SC_WAL_RECORD_HEADER) {
+        uint32_t header[2];
+        memcpy(header, log + pos, sizeof(header));
+        const unsigned char* body = log + pos + SC_WAL_RECORD_HEADER;
+        size_t body_size = header[1];
+        if (body_size < SC_WAL_BODY_HEADER || body_size > size - pos - SC_WAL_RECORD_HEADER ||
+            sc_crc32(body, body_size) != header[0]) {
+            break;
+        }
+        uint16_t lengths[4];
+        uint32_t value_size;
+        memcpy(lengths, body, sizeof(lengths));
+        memcpy(&value_size, body + 8, sizeof(value_size));
+        if ((size_t)SC_WAL_BODY_HEADER + lengths[1] + lengths[2] + value_size != body_size) {
+            break;
+        }
+        memcpy(addr, body + SC_WAL_BODY_HEADER, lengths[1]);
+        addr[lengths[1]] = '\0';
+        memcpy(type, body + SC_WAL_BODY_HEADER + lengths[1], lengths[2]);
+        type[lengths[2]] = '\0';
+        if (lengths[0] == SC_WAL_STORE) {
+            sc_memory_store_copy(ctx, addr, body + SC_WAL_BODY_HEADER + lengths[1] + lengths[2], value_size, type);
+        } else if (lengths[0] == SC_WAL_REMOVE) {
+            sc_memory_remove(ctx, addr);
+        } else {
+            break;
+        }
+        pos += SC_WAL_RECORD_HEADER + body_size;
+        applied++;
+    }
+    ctx->wal = wal;
+
+    munmap(log, size);
+    if (pos < size && ftruncate(fd, (off_t)pos) != 0) {
+        fprintf(stderr, "Cannot cut the torn tail of SC write-ahead log: %s\n", path);
+    }
+    close(fd);
+    return applied;
+}
+
+// Saves ctx as a snapshot and empties the log, whose records it now contains.
+// The log is only cut once the snapshot and its rename are synced, so a crash
+// in between only replays records the snapshot already holds.
+sc_result sc_wal_checkpoint(sc_memory_context* ctx, sc_wal* wal, const char* snapshot_path) {
+    if (sc_wal_commit(wal) != SC_RESULT_OK || sc_snapshot_write(ctx, snapshot_path) != SC_RESULT_OK) {
+        return SC_RESULT_ERROR;
+    }
+    if (ftruncate(wal->fd, 0) != 0 || fdatasync(wal->fd) != 0) {
+        fprintf(stderr, "Cannot empty SC write-ahead log after checkpoint\n");
+        return SC_RESULT_ERROR;
+    }
+    return SC_RESULT_OK;
+}
+
+// Snapshot, then log changes in small groups, tear the tail, recover into a
+// fresh context and check the log keeps working after the cut
+int sc_wal_selftest(void) {
+    sc_type_register("int", sizeof(int));
+    char dir[] = "/tmp/sc_wal_XXXXXX";
+    if (mkdtemp(dir) == NULL) {
+        printf("%-8s %s\n", "wal", "SKIPPED (no temporary directory)");
+        return 1;
+    }
+    char snapshot_path[64], wal_path[64], addr[32];
+    snprintf(snapshot_path, sizeof(snapshot_path), "%s/memory.snap", dir);
+    snprintf(wal_path, sizeof(wal_path), "%s/memory.wal", dir);
+
+    sc_memory_context ctx;
+    sc_memory_init(&ctx, 16);
+    for (int k = 0; k < 100; k++) {
+        snprintf(addr, sizeof(addr), "key%d", k);
+        sc_memory_store(&ctx, addr, &k, "int");
+    }
+    sc_wal wal;
+    int errors = sc_wal_open(&wal, wal_path, 256, 1000) != SC_RESULT_OK;
+    errors += sc_wal_checkpoint(&ctx, &wal, snapshot_path) != SC_RESULT_OK;
+    sc_memory_attach_wal(&ctx, &wal);
+    for (int k = 0; k < 100; k += 2) {
+        int value = -k;
+        snprintf(addr, sizeof(addr), "key%d", k);
+        sc_memory_store(&ctx, addr, &value, "int");
+        sc_memory_store(&ctx, addr, &value, "int"); // unchanged: not logged
+    }
+    sc_memory_remove(&ctx, "key3");
+    uint64_t logged = wal.records;
+    uint64_t commits = wal.commits;
+    sc_wal_close(&wal);
+    sc_memory_destroy(&ctx);
+
+    // A torn record at the end, as left by a crash in the middle of a write
+    FILE* file = fopen(wal_path, "ab");
+    errors += file == NULL;
+    if (file != NULL) {
+        fputs("torn record", file);
+        fclose(file);
+    }
+
+    sc_snapshot snap;
+    errors += sc_snapshot_open(&snap, snapshot_path) != SC_RESULT_OK;
+    sc_memory_init(&ctx, 16);
+    sc_memory_attach_snapshot(&ctx, &snap);
+    size_t replayed = sc_wal_replay(&ctx, wal_path);
+    errors += replayed != logged || sc_memory_get(&ctx, "key3", "int") != NULL;
+    for (int k = 0; k < 100; k++) {
+        snprintf(addr, sizeof(addr), "key%d", k);
+        int* value = sc_memory_get(&ctx, addr, "int");
+        errors += k != 3 && (value == NULL || *value != (k % 2 == 0 ? -k : k));
+    }
+
+    // Records appended after recovery must follow the last good one
+    errors += sc_wal_open(&wal, wal_path, 0, 1000) != SC_RESULT_OK;
+    sc_memory_attach_wal(&ctx, &wal);
+    int restored = 3;
+    sc_memory_store(&ctx, "key3", &restored, "int");
+    sc_wal_close(&wal);
+    sc_memory_destroy(&ctx);
+    sc_memory_init(&ctx, 16);
+    sc_memory_attach_snapshot(&ctx, &snap);
+    errors += sc_wal_replay(&ctx, wal_path) != logged + 1;
+    int* value = sc_memory_get(&ctx, "key3", "int");
+    errors += value == NULL || *value != 3;
+    sc_memory_destroy(&ctx);
+    sc_snapshot_close(&snap);
+
+    unlink(wal_path);
+    unlink(snapshot_path);
+    rmdir(dir);
+    printf("%-8s %s (%llu records in %llu group commits, %zu replayed)\n", "wal", errors == 0 ? "ok" : "MISMATCH",
+           (unsigned long long)logged, (unsigned long long)commits, replayed);
+    return errors == 0;
+}
+
+// ==================== SC events ====================
+// OSTIS-style agent activation: agents subscribe to an address or to a type,
+// and every store (or sc_memory_touch) of a matching element queues an
+// activation. A queued (agent, element) pair is coalesced with any later
+// change until the agent actually starts, so a burst of stores runs each
+// affected agent once. sc_event_dispatch() drains the queue in FIFO order;
+// activations queued by running agents are handled in the same call.
+typedef sc_result (*sc_agent_fn)(sc_memory_context* ctx, sc_addr addr);
+
+typedef struct {
+    sc_agent_fn agent;
+    char* addr_name;  // address subscription, re-resolved after sc_memory_reset
+    sc_addr addr;     // SC_ADDR_EMPTY for a type subscription
+    sc_type_id type;
+} sc_subscription;
+
+typedef struct {
+    uint32_t subscription;
+    sc_addr addr;
+} sc_activation;
+
+#define SC_PENDING_EMPTY 0
+#define SC_PENDING_TOMBSTONE UINT64_MAX
+
+struct sc_event_queue {
+    sc_subscription* subscriptions;
+    size_t subscription_count;
+    size_t subscription_capacity;
+
+    sc_activation* queue;
+    size_t head;
+    size_t tail;
+    size_t queue_capacity;
+
+    // Open-addressing set of queued, not yet started (subscription, addr) keys
+    uint64_t* pending;
+    size_t pending_capacity; // power of two
+    size_t pending_used;     // live keys + tombstones
+
+    size_t running; // subscription being dispatched; it is not woken by its own stores
+};
+
+static struct sc_event_queue* sc_event_queue_get(sc_memory_context* ctx) {
+    if (ctx->events == NULL) {
+        ctx->events = calloc(1, sizeof(struct sc_event_queue));
+        ctx->events->pending_capacity = 64;
+        ctx->events->pending = calloc(ctx->events->pending_capacity, sizeof(uint64_t));
+        ctx->events->running = SIZE_MAX;
+    }
+    return ctx->events;
+}
+
+static void sc_event_subscribe(sc_memory_context* ctx, sc_subscription subscription) {
+    struct sc_event_queue* events = sc_event_queue_get(ctx);
+    if (events->subscription_count >= events->subscription_capacity) {
+        events->subscription_capacity = events->subscription_capacity ? events->subscription_capacity * 2 : 8;
+        events->subscriptions = realloc(events->subscriptions,
+                                        events->subscription_capacity * sizeof(sc_subscription));
+    }
+    events->subscriptions[events->subscription_count++] = subscription;
+}
+
+// Runs agent(ctx, addr) whenever addr is stored
+void sc_event_subscribe_addr(sc_memory_context* ctx, const char* addr, sc_agent_fn agent) {
+    sc_event_subscribe(ctx, (sc_subscription){ agent, strdup(addr), sc_memory_resolve(ctx, addr), SC_TYPE_NONE });
+}
+
+// Runs agent(ctx, element) whenever an element of this type is stored
+void sc_event_subscribe_type(sc_memory_context* ctx, sc_type_id type, sc_agent_fn agent) {
+    sc_event_subscribe(ctx, (sc_subscription){ agent, NULL, SC_ADDR_EMPTY, type });
+}
+
+static inline uint64_t sc_event_key(uint32_t subscription, sc_addr addr) {
+    return ((uint64_t)(subscription + 1) << 32) | addr;
+}
+
+static inline uint64_t sc_event_key_hash(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdull;
+    key ^= key >> 33;
+    return key;
+}
+
+// Returns the slot of key, or the slot where it should go when absent
+static size_t sc_event_pending_find(struct sc_event_queue* events, uint64_t key, int* found) {
+    size_t mask = events->pending_capacity - 1;
+    size_t pos = sc_event_key_hash(key) & mask;
+    size_t insert_at = SIZE_MAX;
+    for (;;) {
+        uint64_t slot = events->pending[pos];
+        if (slot == key) {
+            *found = 1;
+            return pos;
+        }
+        if (slot == SC_PENDING_EMPTY) {
+            *found = 0;
+            return insert_at != SIZE_MAX ? insert_at : pos;
+        }
+        if (slot == SC_PENDING_TOMBSTONE && insert_at == SIZE_MAX) {
+            insert_at = pos;
+        }
+        pos = (pos + 1) & mask;
+    }
+}
+
+static void sc_event_pending_rebuild(struct sc_event_queue* events, size_t capacity) {
+    free(events->pending);
+    events->pending = calloc(capacity, sizeof(uint64_t));
+    events->pending_capacity = capacity;
+    events->pending_used = 0;
+    // Every queued activation that has not started yet is pending
+    for (size_t i = events->head; i < events->tail; i++) {
+        int found;
+        uint64_t key = sc_event_key(events->queue[i].subscription, events->queue[i].addr);
+        events->pending[sc_event_pending_find(events, key, &found)] = key;
+        events->pending_used++;
+    }
+}
+
+static void sc_event_enqueue(struct sc_event_queue* events, uint32_t subscription, sc_addr addr) {
+    int found;
+    uint64_t key = sc_event_key(subscription, addr);
+    size_t pos = sc_event_pending_find(events, key, &found);
+    if (found) {
+        return; // coalesced with the activation that is already queued
+    }
+
+    if ((events->pending_used + 1) * 4 > events->pending_capacity * 3) {
+        size_t capacity = events->pending_capacity;
+        while ((events->tail - events->head + 1) * 2 > capacity) {
+            capacity *= 2;
+        }
+        sc_event_pending_rebuild(events, capacity);
+        pos = sc_event_pending_find(events, key, &found);
+    }
+    if (events->pending[pos] == SC_PENDING_EMPTY) {
+        events->pending_used++;
+    }
+    events->pending[pos] = key;
+
+    if (events->tail >= events->queue_capacity) {
+        // Compact consumed activations away before growing
+        size_t queued = events->tail - events->head;
+        if (events->head > 0) {
+            memmove(events->queue, events->queue + events->head, queued * sizeof(sc_activation));
+            events->head = 0;
+            events->tail = queued;
+        }
+        if (queued >= events->queue_capacity) {
+            events->queue_capacity = events->queue_capacity ? events->queue_capacity * 2 : 64;
+            events->queue = realloc(events->queue, events->queue_capacity * sizeof(sc_activation));
+        }
+    }
+    events->queue[events->tail++] = (sc_activation){ subscription, addr };
+}
+
+static void sc_event_notify(sc_memory_context* ctx, sc_addr handle, sc_type_id type) {
+    struct sc_event_queue* events = ctx->events;
+    for (size_t i = 0; i < events->subscription_count; i++) {
+        const sc_subscription* subscription = &events->subscriptions[i];
+        if (i == events->running) {
+            continue;
+        }
+        if (subscription->addr == handle || (subscription->addr == SC_ADDR_EMPTY && subscription->type == type)) {
+            sc_event_enqueue(events, (uint32_t)i, handle);
+        }
+    }
+}
+
+// Records an in-place change of an element: bumps its version and activates
+// its subscribers
+void sc_memory_touch(sc_memory_context* ctx, sc_addr handle) {
+    ctx->entries[handle - 1].version++;
+    if (ctx->wal != NULL) {
+        sc_wal_log_store(ctx, handle);
+    }
+    if (ctx->events != NULL) {
+        sc_event_notify(ctx, handle, ctx->entries[handle - 1].type);
+    }
+}
+
+// Runs queued activations until the queue is empty; returns how many ran and
+// adds the failed ones to *failed when it is not NULL
+size_t sc_event_dispatch(sc_memory_context* ctx, size_t* failed) {
+    struct sc_event_queue* events = ctx->events;
+    size_t ran = 0;
+    while (events != NULL && events->head < events->tail) {
+        sc_activation activation = events->queue[events->head++];
+        int found;
+        size_t pos = sc_event_pending_find(events, sc_event_key(activation.subscription, activation.addr), &found);
+        events->pending[pos] = SC_PENDING_TOMBSTONE;
+
+        events->running = activation.subscription;
+        sc_result result = events->subscriptions[activation.subscription].agent(ctx, activation.addr);
+        events->running = SIZE_MAX;
+        if (result != SC_RESULT_OK && failed != NULL) {
+            (*failed)++;
+        }
+        ran++;
+    }
+    if (events != NULL) {
+        events->head = events->tail = 0;
+        sc_event_pending_rebuild(events, events->pending_capacity);
+    }
+    return ran;
+}
+
+// Whether an address subscription is bound to handle
+static int sc_event_subscribed(const sc_memory_context* ctx, sc_addr handle) {
+    const struct sc_event_queue* events = ctx->events;
+    for (size_t i = 0; i < events->subscription_count; i++) {
+        if (events->subscriptions[i].addr_name != NULL && events->subscriptions[i].addr == handle) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void sc_event_queue_reset(sc_memory_context* ctx) {
+    struct sc_event_queue* events = ctx->events;
+    events->head = events->tail = 0;
+    sc_event_pending_rebuild(events, events->pending_capacity);
+    for (size_t i = 0; i < events->subscription_count; i++) {
+        if (events->subscriptions[i].addr_name != NULL) {
+            events->subscriptions[i].addr = sc_memory_resolve(ctx, events->subscriptions[i].addr_name);
+        }
+    }
+}
+
+static void sc_event_queue_destroy(sc_memory_context* ctx) {
+    struct sc_event_queue* events = ctx->events;
+    for (size_t i = 0; i < events->subscription_count; i++) {
+        free(events->subscriptions[i].addr_name);
+    }
+    free(events->subscriptions);
+    free(events->queue);
+    free(events->pending);
+    free(events);
+    ctx->events = NULL;
+}
+
+static size_t sc_event_selftest_runs;
+static const char* sc_event_selftest_seen;
+
+static sc_result sc_event_selftest_agent(sc_memory_context* ctx, sc_addr addr) {
+    sc_event_selftest_runs++;
+    sc_event_selftest_seen = ctx->entries[addr - 1].addr;
+    return SC_RESULT_OK;
+}
+
+// A removed element that is stored again still activates its subscriber,
+// and its handle is not handed to another address in the meantime
+int sc_event_selftest(void) {
+    sc_type_register("int", sizeof(int));
+    sc_memory_context ctx;
+    sc_memory_init(&ctx, 8);
+    sc_event_subscribe_addr(&ctx, "input_triangle", sc_event_selftest_agent);
+    int value = 1;
+    sc_memory_store(&ctx, "input_triangle", &value, "int");
+    int errors = sc_event_dispatch(&ctx, NULL) != 1;
+    errors += !sc_memory_remove(&ctx, "input_triangle");
+    errors += sc_memory_remove(&ctx, "input_triangle");
+    errors += sc_memory_find(&ctx, "input_triangle") == SC_ADDR_EMPTY;
+
+    sc_event_selftest_runs = 0;
+    sc_memory_store(&ctx, "unrelated", &value, "int");
+    errors += sc_event_dispatch(&ctx, NULL) != 0;
+    sc_memory_store(&ctx, "input_triangle", &value, "int");
+    errors += sc_event_dispatch(&ctx, NULL) != 1;
+    errors += sc_event_selftest_runs != 1 || sc_event_selftest_seen == NULL ||
+              strcmp(sc_event_selftest_seen, "input_triangle") != 0;
+    sc_memory_destroy(&ctx);
+
+    printf("%-8s %s (%zu activation after remove and re-store)\n", "events", errors == 0 ? "ok" : "MISMATCH",
+           sc_event_selftest_runs);
+    return errors == 0;
+}
+
+// ==================== SC log ====================
+// Events are either formatted and printed on the spot or, once sc_log_start()
+// has been called, pushed as (format id, raw arguments) into a bounded
+// multi-producer ring and formatted by a background flusher thread. Producers
+// never format, allocate or take a lock.
+//
+// Every event has a level. Call sites below SC_LOG_COMPILE_LEVEL are removed
+// by the preprocessor together with their argument expressions; the rest are
+// filtered at run time by sc_log_set_level().
+#define SC_LOG_LEVEL_TRACE 0
+#define SC_LOG_LEVEL_DEBUG 1
+#define SC_LOG_LEVEL_INFO 2
+#define SC_LOG_LEVEL_WARN 3
+#define SC_LOG_LEVEL_ERROR 4
+#define SC_LOG_LEVEL_OFF 5
+
+#ifndef SC_LOG_COMPILE_LEVEL
+#ifdef NDEBUG
+#define SC_LOG_COMPILE_LEVEL SC_LOG_LEVEL_INFO
+#else
+#define SC_LOG_COMPILE_LEVEL SC_LOG_LEVEL_TRACE
+#endif
+#endif
+
+static atomic_int sc_log_level = SC_LOG_LEVEL_INFO;
+
+void sc_log_set_level(int level) {
+    atomic_store_explicit(&sc_log_level, level, memory_order_relaxed);
+}
+
+static inline int sc_log_enabled(int level) {
+    return level >= atomic_load_explicit(&sc_log_level, memory_order_relaxed);
+}
+
+#define SC_LOG_AT(level, ...)                \
+    do {                                     \
+        if (sc_log_enabled(level)) {         \
+            sc_log_eventf(__VA_ARGS__);      \
+        }                                    \
+    } while (0)
+
+#if SC_LOG_COMPILE_LEVEL <= SC_LOG_LEVEL_TRACE
+#define SC_LOG_TRACE(...) SC_LOG_AT(SC_LOG_LEVEL_TRACE, __VA_ARGS__)
+#else
+#define SC_LOG_TRACE(...) ((void)0)
+#endif
+#if SC_LOG_COMPILE_LEVEL <= SC_LOG_LEVEL_DEBUG
+#define SC_LOG_DEBUG(...) SC_LOG_AT(SC_LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define SC_LOG_DEBUG(...) ((void)0)
+#endif
+#if SC_LOG_COMPILE_LEVEL <= SC_LOG_LEVEL_INFO
+#define SC_LOG_INFO(...) SC_LOG_AT(SC_LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define SC_LOG_INFO(...) ((void)0)
+#endif
+#if SC_LOG_COMPILE_LEVEL <= SC_LOG_LEVEL_WARN
+#define SC_LOG_WARN(...) SC_LOG_AT(SC_LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define SC_LOG_WARN(...) ((void)0)
+#endif
+#if SC_LOG_COMPILE_LEVEL <= SC_LOG_LEVEL_ERROR
+#define SC_LOG_ERROR(...) SC_LOG_AT(SC_LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define SC_LOG_ERROR(...) ((void)0)
+#endif
+
+typedef enum {
+    SC_LOG_FMT_TEXT,
+    SC_LOG_FMT_CALCULATED_ANGLE,
+    SC_LOG_FMT_BATCH_CALCULATED,
+    SC_LOG_FMT_BATCH_RIGHT,
+    SC_LOG_FMT_BATCH_PROCESSED,
+    SC_LOG_FMT_CALCULATION_ERROR,
+    SC_LOG_FMT_DROPPED,
+    SC_LOG_FMT_COUNT
+} sc_log_format;
+
+typedef struct {
+    const char* format;
+    const char* args; // one kind per argument: 'd' double, 'u' size_t, 's' static string
+} sc_log_format_info;
+
+static const sc_log_format_info sc_log_formats[SC_LOG_FMT_COUNT] = {
+    [SC_LOG_FMT_TEXT] = { "%s", "s" },
+    [SC_LOG_FMT_CALCULATED_ANGLE] = { "Calculated angle: %.2f°", "d" },
+    [SC_LOG_FMT_BATCH_CALCULATED] = { "Calculated angles for %zu of %zu triangles", "uu" },
+    [SC_LOG_FMT_BATCH_RIGHT] = { "Right angle detected in %zu of %zu triangles", "uu" },
+    [SC_LOG_FMT_BATCH_PROCESSED] = { "Processed %zu triangles: %zu completed, %zu right-angled", "uuu" },
+    [SC_LOG_FMT_CALCULATION_ERROR] = { "Angle calculation error: %s", "s" },
+    [SC_LOG_FMT_DROPPED] = { "%zu log events dropped", "u" },
+};
+
+#define SC_LOG_MAX_ARGS 4
+
+typedef union {
+    double d;
+    size_t u;
+    const char* s;
+} sc_log_arg;
+
+typedef struct {
+    _Alignas(64) atomic_size_t sequence;
+    sc_log_format format;
+    sc_log_arg args[SC_LOG_MAX_ARGS];
+} sc_log_record;
+
+typedef enum {
+    SC_LOG_DROP,  // a full ring drops the event and counts it
+    SC_LOG_BLOCK  // a full ring makes the producer wait for the flusher
+} sc_log_policy;
+
+typedef struct {
+    sc_log_record* ring;
+    size_t mask;
+    sc_log_policy policy;
+    FILE* out;
+    _Alignas(64) atomic_size_t tail; // next slot producers claim
+    _Alignas(64) atomic_size_t head; // next slot the flusher reads
+    atomic_size_t dropped;
+    atomic_int running;
+    pthread_t flusher;
+} sc_log_state;
+
+static sc_log_state sc_log;
+static atomic_int sc_log_async = 0;
+
+// Formats one record; conversions are handed to snprintf one at a time with
+// the argument type the format table declares.
+static size_t sc_log_format_record(char* buf, size_t size, sc_log_format format, const sc_log_arg* args) {
+    const char* fmt = sc_log_formats[format].format;
+    const char* kinds = sc_log_formats[format].args;
+    size_t len = 0;
+    while (*fmt && len + 1 < size) {
+        if (*fmt != '%') {
+            buf[len++] = *fmt++;
+            continue;
+        }
+        if (fmt[1] == '%') {
+            buf[len++] = '%';
+            fmt += 2;
+            continue;
+        }
+        char spec[16];
+        size_t n = 0;
+        do {
+            spec[n++] = *fmt++;
+        } while (*fmt && n < sizeof(spec) - 2 && !strchr("diouxXeEfFgGaAcsp", *fmt));
+        spec[n++] = *fmt ? *fmt++ : 's';
+        spec[n] = '\0';
+
+        int written = 0;
+        switch (*kinds++) {
+        case 'd': written = snprintf(buf + len, size - len, spec, args->d); break;
+        case 'u': written = snprintf(buf + len, size - len, spec, args->u); break;
+        default: written = snprintf(buf + len, size - len, spec, args->s); break;
+        }
+        args++;
+        if (written > 0) {
+            len += (size_t)written < size - len ? (size_t)written : size - len - 1;
+        }
+    }
+    buf[len] = '\0';
+    return len;
+}
+
+static void* sc_log_flusher_run(void* arg) {
+    (void)arg;
+    char out[64 * 1024];
+    size_t used = 0;
+    unsigned idle = 0;
+
+    for (;;) {
+        size_t head = atomic_load_explicit(&sc_log.head, memory_order_relaxed);
+        sc_log_record* record = &sc_log.ring[head & sc_log.mask];
+        if (atomic_load_explicit(&record->sequence, memory_order_acquire) == head + 1) {
+            if (used + 512 > sizeof(out)) {
+                fwrite(out, 1, used, sc_log.out);
+                used = 0;
+            }
+            memcpy(out + used, "[SC] ", 5);
+            used += 5;
+            used += sc_log_format_record(out + used, sizeof(out) - used - 1, record->format, record->args);
+            out[used++] = '\n';
+            atomic_store_explicit(&record->sequence, head + sc_log.mask + 1, memory_order_release);
+            atomic_store_explicit(&sc_log.head, head + 1, memory_order_release);
+            idle = 0;
+            continue;
+        }
+
+        // Ring is empty: hand what we have to stdio, then back off
+        if (used > 0) {
+            fwrite(out, 1, used, sc_log.out);
+            fflush(sc_log.out);
+            used = 0;
+        }
+        if (!atomic_load_explicit(&sc_log.running, memory_order_acquire) &&
+            atomic_load_explicit(&sc_log.tail, memory_order_acquire) == head) {
+            break;
+        }
+        if (++idle < 64) {
+            sched_yield();
+        } else {
+            nanosleep(&(struct timespec){ 0, 200000 }, NULL);
+        }
+    }
+    return NULL;
+}
+
+// Switches logging to the asynchronous ring; capacity is rounded up to a power of two
+void sc_log_start(FILE* out, size_t capacity, sc_log_policy policy) {
+    size_t slots = 2;
+    while (slots < capacity) {
+        slots *= 2;
+    }
+    sc_log.ring = aligned_alloc(64, slots * sizeof(sc_log_record));
+    for (size_t i = 0; i < slots; i++) {
+        atomic_init(&sc_log.ring[i].sequence, i);
+    }
+    sc_log.mask = slots - 1;
+    sc_log.policy = policy;
+    sc_log.out = out;
+    atomic_init(&sc_log.tail, 0);
+    atomic_init(&sc_log.head, 0);
+    atomic_init(&sc_log.dropped, 0);
+    atomic_init(&sc_log.running, 1);
+    pthread_create(&sc_log.flusher, NULL, sc_log_flusher_run, NULL);
+    atomic_store(&sc_log_async, 1);
+}
+
+// Waits until every event logged so far has been written out
+void sc_log_flush(void) {
+    if (!atomic_load(&sc_log_async)) {
+        fflush(stdout);
+        return;
+    }
+    size_t target = atomic_load(&sc_log.tail);
+    while (atomic_load_explicit(&sc_log.head, memory_order_acquire) < target) {
+        sched_yield();
+    }
+}
+
+size_t sc_log_dropped(void) {
+    return atomic_load_explicit(&sc_log.dropped, memory_order_relaxed);
+}
+
+// Drains the ring, reports drops and returns to synchronous logging.
+// No other thread may log while this runs.
+void sc_log_stop(void) {
+    if (!atomic_load(&sc_log_async)) {
+        return;
+    }
+    atomic_store(&sc_log.running, 0);
+    pthread_join(sc_log.flusher, NULL);
+    atomic_store(&sc_log_async, 0);
+
+    size_t dropped = sc_log_dropped();
+    if (dropped > 0) {
+        char line[64];
+        sc_log_format_record(line, sizeof(line), SC_LOG_FMT_DROPPED, &(sc_log_arg){ .u = dropped });
+        fprintf(sc_log.out, "[SC] %s\n", line);
+    }
+    fflush(sc_log.out);
+    free(sc_log.ring);
+    sc_log.ring = NULL;
+}
+
+static void sc_log_push(sc_log_format format, const sc_log_arg* args) {
+    if (!atomic_load_explicit(&sc_log_async, memory_order_relaxed)) {
+        char line[256];
+        sc_log_format_record(line, sizeof(line), format, args);
+        printf("[SC] %s\n", line);
+        return;
+    }
+
+    // Vyukov bounded MPMC queue, producer side
+    size_t pos = atomic_load_explicit(&sc_log.tail, memory_order_relaxed);
+    sc_log_record* record;
+    for (;;) {
+        record = &sc_log.ring[pos & sc_log.mask];
+        size_t sequence = atomic_load_explicit(&record->sequence, memory_order_acquire);
+        intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&sc_log.tail, &pos, pos + 1, memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // Full
+            if (sc_log.policy == SC_LOG_DROP) {
+                atomic_fetch_add_explicit(&sc_log.dropped, 1, memory_order_relaxed);
+                return;
+            }
+            sched_yield();
+            pos = atomic_load_explicit(&sc_log.tail, memory_order_relaxed);
+        } else {
+            pos = atomic_load_explicit(&sc_log.tail, memory_order_relaxed);
+        }
+    }
+
+    record->format = format;
+    memcpy(record->args, args, sizeof(record->args));
+    atomic_store_explicit(&record->sequence, pos + 1, memory_order_release);
+}
+
+// Logs a predefined event; arguments follow the kinds in sc_log_formats
+void sc_log_eventf(sc_log_format format, ...) {
+    sc_log_arg args[SC_LOG_MAX_ARGS] = { { 0 } };
+    va_list ap;
+    va_start(ap, format);
+    for (const char* kind = sc_log_formats[format].args; *kind; kind++) {
+        sc_log_arg* arg = &args[kind - sc_log_formats[format].args];
+        switch (*kind) {
+        case 'd': arg->d = va_arg(ap, double); break;
+        case 'u': arg->u = va_arg(ap, size_t); break;
+        default: arg->s = va_arg(ap, const char*); break;
+        }
+    }
+    va_end(ap);
+    sc_log_push(format, args);
+}
+
+// Logs msg at info level. It is logged by reference and must outlive the
+// flusher (e.g. a literal).
+void sc_log_event(const char* msg) {
+    if (sc_log_enabled(SC_LOG_LEVEL_INFO)) {
+        sc_log_push(SC_LOG_FMT_TEXT, &(sc_log_arg){ .s = msg });
+    }
+}
+
+#define SC_LOG_SELFTEST_THREADS 4
+#define SC_LOG_SELFTEST_EVENTS 25000
+
+static void* sc_log_selftest_run(void* arg) {
+    (void)arg;
+    for (size_t i = 0; i < SC_LOG_SELFTEST_EVENTS; i++) {
+        sc_log_eventf(SC_LOG_FMT_BATCH_CALCULATED, i, (size_t)SC_LOG_SELFTEST_EVENTS);
+    }
+    return NULL;
+}
+
+// Logs from several threads into a temporary file under the given policy and
+// returns the number of lines written; *dropped receives the drop counter.
+static size_t sc_log_selftest_round(size_t capacity, sc_log_policy policy, size_t* dropped) {
+    FILE* out = tmpfile();
+    sc_log_start(out, capacity, policy);
+    pthread_t threads[SC_LOG_SELFTEST_THREADS];
+    for (int t = 0; t < SC_LOG_SELFTEST_THREADS; t++) {
+        pthread_create(&threads[t], NULL, sc_log_selftest_run, NULL);
+    }
+    for (int t = 0; t < SC_LOG_SELFTEST_THREADS; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    *dropped = sc_log_dropped();
+    sc_log_stop();
+
+    rewind(out);
+    size_t lines = 0;
+    int c;
+    while ((c = fgetc(out)) != EOF) {
+        lines += c == '\n';
+    }
+    fclose(out);
+    return lines;
+}
+
+// Blocking mode must deliver every event; drop mode must account for every
+// event either as a line or in the drop counter (plus one summary line).
+int sc_log_selftest(void) {
+    const size_t total = (size_t)SC_LOG_SELFTEST_THREADS * SC_LOG_SELFTEST_EVENTS;
+    size_t dropped;
+    size_t lines = sc_log_selftest_round(1024, SC_LOG_BLOCK, &dropped);
+    int ok = lines == total && dropped == 0;
+
+    size_t lossy_lines = sc_log_selftest_round(16, SC_LOG_DROP, &dropped);
+    ok &= lossy_lines - (dropped > 0) + dropped == total;
+
+    printf("%-8s %s (%zu events blocking, %zu of %zu dropped on a 16-slot ring)\n", "log", ok ? "ok" : "MISMATCH",
+           lines, dropped, total);
+    return ok;
+}
+
+// ==================== thread pool ====================
+// Work-stealing pool for data-parallel agent runs. A parallel_for call cuts
+// [0, count) into chunks, hands each worker a contiguous run of them, and
+// idle workers steal from the opposite end of the other deques. Chunks never
+// spawn more work, so a worker is done once every deque is empty.
+typedef void (*sc_task_fn)(void* arg, size_t begin, size_t end);
+
+typedef struct {
+    size_t begin;
+    size_t end;
+} sc_task_range;
+
+typedef struct {
+    pthread_mutex_t lock;
+    sc_task_range* tasks;
+    size_t head; // thieves take from here
+    size_t tail; // the owner pops from here
+    size_t capacity;
+} sc_task_deque;
+
+typedef struct sc_thread_pool sc_thread_pool;
+
+typedef struct {
+    sc_thread_pool* pool;
+    size_t id;
+} sc_worker;
+
+struct sc_thread_pool {
+    size_t worker_count;
+    pthread_t* threads;
+    sc_worker* workers;
+    sc_task_deque* deques;
+
+    pthread_mutex_t lock;
+    pthread_cond_t job_ready;
+    pthread_cond_t job_done;
+    size_t generation;   // bumped for every parallel_for
+    size_t busy_workers; // workers still draining the current job
+    int shutdown;
+
+    sc_task_fn fn;
+    void* arg;
+};
+
+static int sc_task_deque_pop(sc_task_deque* deque, sc_task_range* task) {
+    pthread_mutex_lock(&deque->lock);
+    int found = deque->tail > deque->head;
+    if (found) {
+        *task = deque->tasks[--deque->tail];
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return found;
+}
+
+static int sc_task_deque_steal(sc_task_deque* deque, sc_task_range* task) {
+    pthread_mutex_lock(&deque->lock);
+    int found = deque->tail > deque->head;
+    if (found) {
+        *task = deque->tasks[deque->head++];
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return found;
+}
+
+static void sc_thread_pool_drain(sc_thread_pool* pool, size_t id) {
+    sc_task_range task;
+    for (;;) {
+        if (sc_task_deque_pop(&pool->deques[id], &task)) {
+            pool->fn(pool->arg, task.begin, task.end);
+            continue;
+        }
+        int stolen = 0;
+        for (size_t k = 1; k < pool->worker_count && !stolen; k++) {
+            stolen = sc_task_deque_steal(&pool->deques[(id + k) % pool->worker_count], &task);
+        }
+        if (!stolen) {
+            return;
+        }
+        pool->fn(pool->arg, task.begin, task.end);
+    }
+}
+
+static void* sc_thread_pool_worker(void* arg) {
+    sc_worker* worker = arg;
+    sc_thread_pool* pool = worker->pool;
+    size_t seen = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->shutdown && pool->generation == seen) {
+            pthread_cond_wait(&pool->job_ready, &pool->lock);
+        }
+        if (pool->shutdown) {
+            break;
+        }
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        sc_thread_pool_drain(pool, worker->id);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->busy_workers == 0) {
+            pthread_cond_signal(&pool->job_done);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+// worker_count == 0 uses one worker per online CPU
+void sc_thread_pool_init(sc_thread_pool* pool, size_t worker_count) {
+    if (worker_count == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        worker_count = cpus > 0 ? (size_t)cpus : 1;
+    }
+    pool->worker_count = worker_count;
+    pool->threads = malloc(worker_count * sizeof(pthread_t));
+    pool->workers = malloc(worker_count * sizeof(sc_worker));
+    pool->deques = calloc(worker_count, sizeof(sc_task_deque));
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->job_ready, NULL);
+    pthread_cond_init(&pool->job_done, NULL);
+    pool->generation = 0;
+    pool->busy_workers = 0;
+    pool->shutdown = 0;
+    pool->fn = NULL;
+    pool->arg = NULL;
+
+    for (size_t i = 0; i < worker_count; i++) {
+        pthread_mutex_init(&pool->deques[i].lock, NULL);
+        pool->workers[i].pool = pool;
+        pool->workers[i].id = i;
+        if (pthread_create(&pool->threads[i], NULL, sc_thread_pool_worker, &pool->workers[i]) != 0) {
+            fprintf(stderr, "Cannot start thread pool worker %zu\n", i);
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+void sc_thread_pool_destroy(sc_thread_pool* pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->job_ready);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (size_t i = 0; i < pool->worker_count; i++) {
+        pthread_join(pool->threads[i], NULL);
+        pthread_mutex_destroy(&pool->deques[i].lock);
+        free(pool->deques[i].tasks);
+    }
+    pthread_cond_destroy(&pool->job_done);
+    pthread_cond_destroy(&pool->job_ready);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->deques);
+    free(pool->workers);
+    free(pool->threads);
+}
+
+// Binds thread to one CPU; returns 0 where affinity is unavailable
+int sc_thread_pin(pthread_t thread, size_t cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu % CPU_SETSIZE, &set);
+    return pthread_setaffinity_np(thread, sizeof(set), &set) == 0;
+}
+
+// Pins worker i to CPU (first_cpu + i) modulo the online CPUs; returns how
+// many were pinned
+size_t sc_thread_pool_pin(sc_thread_pool* pool, size_t first_cpu) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t pinned = 0;
+    for (size_t i = 0; i < pool->worker_count; i++) {
+        pinned += (size_t)sc_thread_pin(pool->threads[i], (first_cpu + i) % (size_t)(cpus > 0 ? cpus : 1));
+    }
+    return pinned;
+}
+
+// Calls fn(arg, begin, end) for every chunk of [0, count) and waits for all of
+// them. Chunks are disjoint, so results written per index are deterministic
+// whatever worker runs them. pool == NULL runs everything on the caller.
+void sc_thread_pool_parallel_for(sc_thread_pool* pool, size_t count, size_t chunk, sc_task_fn fn, void* arg) {
+    if (count == 0) {
+        return;
+    }
+    if (chunk == 0) {
+        chunk = 1;
+    }
+    size_t chunk_count = (count + chunk - 1) / chunk;
+    if (pool == NULL || pool->worker_count == 1 || chunk_count == 1) {
+        fn(arg, 0, count);
+        return;
+    }
+
+    // Worker i starts with chunks [i * n / W, (i + 1) * n / W)
+    for (size_t i = 0; i < pool->worker_count; i++) {
+        sc_task_deque* deque = &pool->deques[i];
+        size_t first = i * chunk_count / pool->worker_count;
+        size_t last = (i + 1) * chunk_count / pool->worker_count;
+        if (last - first > deque->capacity) {
+            deque->capacity = last - first;
+            deque->tasks = realloc(deque->tasks, deque->capacity * sizeof(sc_task_range));
+        }
+        deque->head = 0;
+        deque->tail = 0;
+        // Push in reverse so the owner pops its chunks front to back
+        for (size_t c = last; c > first; c--) {
+            size_t begin = (c - 1) * chunk;
+            size_t end = begin + chunk < count ? begin + chunk : count;
+            deque->tasks[deque->tail++] = (sc_task_range){ begin, end };
+        }
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->fn = fn;
+    pool->arg = arg;
+    pool->busy_workers = pool->worker_count;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->job_ready);
+    while (pool->busy_workers > 0) {
+        pthread_cond_wait(&pool->job_done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// ==================== concurrent SC memory ====================
+// Thread-safe SC memory for parallel agents: elements are spread over
+// power-of-two many shards by address hash, each a plain sc_memory_context
+// behind its own reader-writer lock. Readers of different elements never
+// contend on a write lock, and a store only blocks its own shard. Values are
+// copied out under the lock because a concurrent store may move them.
+typedef struct {
+    _Alignas(64) pthread_rwlock_t lock;
+    sc_memory_context memory;
+} sc_memory_shard;
+
+typedef struct {
+    sc_memory_shard* shards;
+    size_t shard_count;
+    unsigned shard_shift; // shards are picked by the top hash bits
+} sc_concurrent_memory_context;
+
+// Shard in the high half, shard-local sc_addr in the low half
+typedef uint64_t sc_shard_addr;
+#define SC_SHARD_ADDR_EMPTY 0
+
+void sc_concurrent_memory_init(sc_concurrent_memory_context* cctx, size_t shard_count, size_t initial_capacity) {
+    size_t count = 1;
+    unsigned bits = 0;
+    while (count < shard_count) {
+        count *= 2;
+        bits++;
+    }
+    cctx->shards = aligned_alloc(64, count * sizeof(sc_memory_shard));
+    cctx->shard_count = count;
+    cctx->shard_shift = 32 - bits;
+    for (size_t i = 0; i < count; i++) {
+        pthread_rwlock_init(&cctx->shards[i].lock, NULL);
+        sc_memory_init(&cctx->shards[i].memory, initial_capacity / count + 1);
+    }
+}
+
+void sc_concurrent_memory_destroy(sc_concurrent_memory_context* cctx) {
+    for (size_t i = 0; i < cctx->shard_count; i++) {
+        sc_memory_destroy(&cctx->shards[i].memory);
+        pthread_rwlock_destroy(&cctx->shards[i].lock);
+    }
+    free(cctx->shards);
+    cctx->shards = NULL;
+    cctx->shard_count = 0;
+}
+
+static inline size_t sc_concurrent_shard_of(const sc_concurrent_memory_context* cctx, uint32_t hash) {
+    return cctx->shard_count == 1 ? 0 : hash >> cctx->shard_shift;
+}
+
+sc_shard_addr sc_concurrent_memory_resolve(sc_concurrent_memory_context* cctx, const char* addr) {
+    uint32_t hash = sc_hash_string(addr);
+    size_t shard_id = sc_concurrent_shard_of(cctx, hash);
+    sc_memory_shard* shard = &cctx->shards[shard_id];
+
+    pthread_rwlock_rdlock(&shard->lock);
+    sc_addr handle = sc_memory_find_hashed(&shard->memory, addr, hash);
+    pthread_rwlock_unlock(&shard->lock);
+    if (handle == SC_ADDR_EMPTY) {
+        pthread_rwlock_wrlock(&shard->lock);
+        handle = sc_memory_resolve_hashed(&shard->memory, addr, hash);
+        pthread_rwlock_unlock(&shard->lock);
+    }
+    return ((sc_shard_addr)shard_id << 32) | handle;
+}
+
+void sc_concurrent_memory_store_by_handle(sc_concurrent_memory_context* cctx, sc_shard_addr handle,
+                                          const void* data, sc_type_id type) {
+    sc_memory_shard* shard = &cctx->shards[handle >> 32];
+    pthread_rwlock_wrlock(&shard->lock);
+    sc_memory_store_by_handle(&shard->memory, (sc_addr)handle, data, type);
+    pthread_rwlock_unlock(&shard->lock);
+}
+
+// Copies the value into out (sc_type_size(type) bytes); returns 0 if no value
+// of that type is stored
+int sc_concurrent_memory_get_by_handle(sc_concurrent_memory_context* cctx, sc_shard_addr handle, sc_type_id type,
+                                       void* out) {
+    sc_memory_shard* shard = &cctx->shards[handle >> 32];
+    pthread_rwlock_rdlock(&shard->lock);
+    void* data;
+    sc_memory_try_get_by_handle(&shard->memory, (sc_addr)handle, type, &data);
+    if (data != NULL) {
+        memcpy(out, data, sc_type_size(type));
+    }
+    pthread_rwlock_unlock(&shard->lock);
+    return data != NULL;
+}
+
+void sc_concurrent_memory_store(sc_concurrent_memory_context* cctx, const char* addr, const void* data,
+                                sc_type_id type) {
+    uint32_t hash = sc_hash_string(addr);
+    sc_memory_shard* shard = &cctx->shards[sc_concurrent_shard_of(cctx, hash)];
+    pthread_rwlock_wrlock(&shard->lock);
+    sc_memory_store_by_handle(&shard->memory, sc_memory_resolve_hashed(&shard->memory, addr, hash), data, type);
+    pthread_rwlock_unlock(&shard->lock);
+}
+
+int sc_concurrent_memory_get(sc_concurrent_memory_context* cctx, const char* addr, sc_type_id type, void* out) {
+    uint32_t hash = sc_hash_string(addr);
+    sc_memory_shard* shard = &cctx->shards[sc_concurrent_shard_of(cctx, hash)];
+    pthread_rwlock_rdlock(&shard->lock);
+    sc_addr handle = sc_memory_find_hashed(&shard->memory, addr, hash);
+    void* data = NULL;
+    if (handle != SC_ADDR_EMPTY) {
+        sc_memory_try_get_by_handle(&shard->memory, handle, type, &data);
+    }
+    if (data != NULL) {
+        memcpy(out, data, sc_type_size(type));
+    }
+    pthread_rwlock_unlock(&shard->lock);
+    return data != NULL;
+}
+
+typedef struct {
+    sc_concurrent_memory_context* cctx;
+    sc_type_id int_type;
+    int id;
+    int errors;
+} sc_concurrent_selftest_worker;
+
+#define SC_CONCURRENT_SELFTEST_THREADS 4
+#define SC_CONCURRENT_SELFTEST_KEYS 20000
+
+static void* sc_concurrent_selftest_run(void* arg) {
+    sc_concurrent_selftest_worker* worker = arg;
+    sc_type_id int_type = worker->int_type;
+    char addr[32];
+    for (int k = 0; k < SC_CONCURRENT_SELFTEST_KEYS; k++) {
+        snprintf(addr, sizeof(addr), "t%d-%d", worker->id, k);
+        int value = worker->id * SC_CONCURRENT_SELFTEST_KEYS + k;
+        sc_concurrent_memory_store(worker->cctx, addr, &value, int_type);
+
+        // Read back a key of the next thread, which may or may not exist yet
+        int other = (worker->id + 1) % SC_CONCURRENT_SELFTEST_THREADS;
+        snprintf(addr, sizeof(addr), "t%d-%d", other, k);
+        int read;
+        if (sc_concurrent_memory_get(worker->cctx, addr, int_type, &read) &&
+            read != other * SC_CONCURRENT_SELFTEST_KEYS + k) {
+            worker->errors++;
+        }
+    }
+    return NULL;
+}
+
+// Stores and reads from several threads at once, then checks every value.
+// Types are registered up front: the registry itself is not thread-safe.
+int sc_concurrent_memory_selftest(void) {
+    sc_type_id int_type = sc_type_register("int", sizeof(int));
+    sc_concurrent_memory_context cctx;
+    sc_concurrent_memory_init(&cctx, 16, 16);
+
+    pthread_t threads[SC_CONCURRENT_SELFTEST_THREADS];
+    sc_concurrent_selftest_worker workers[SC_CONCURRENT_SELFTEST_THREADS];
+    for (int t = 0; t < SC_CONCURRENT_SELFTEST_THREADS; t++) {
+        workers[t] = (sc_concurrent_selftest_worker){ &cctx, int_type, t, 0 };
+        pthread_create(&threads[t], NULL, sc_concurrent_selftest_run, &workers[t]);
+    }
+    int errors = 0;
+    for (int t = 0; t < SC_CONCURRENT_SELFTEST_THREADS; t++) {
+        pthread_join(threads[t], NULL);
+        errors += workers[t].errors;
+    }
+
+    char addr[32];
+    for (int t = 0; t < SC_CONCURRENT_SELFTEST_THREADS; t++) {
+        for (int k = 0; k < SC_CONCURRENT_SELFTEST_KEYS; k++) {
+            snprintf(addr, sizeof(addr), "t%d-%d", t, k);
+            int read;
+            if (!sc_concurrent_memory_get(&cctx, addr, int_type, &read) || read != t * SC_CONCURRENT_SELFTEST_KEYS + k) {
+                errors++;
+            }
+        }
+    }
+    printf("%-8s %s (%d threads x %d keys on %zu shards)\n", "shards", errors == 0 ? "ok" : "MISMATCH",
+           SC_CONCURRENT_SELFTEST_THREADS, SC_CONCURRENT_SELFTEST_KEYS, cctx.shard_count);
+    sc_concurrent_memory_destroy(&cctx);
+    return errors == 0;
+}
+
+// ==================== agent stats ====================
+// Per-agent invocation counters and latency histograms. Every thread records
+// into its own block, so the hot path is two timestamp reads plus a few
+// relaxed, uncontended stores; sc_stats_collect() sums the blocks on demand.
+// Latencies are kept in raw ticks (the TSC on x86-64) in log-linear HDR-style
+// buckets, 16 per power of two (within 6.25%), and converted to nanoseconds
+// when collected. Disabled by default; then the cost is one relaxed load.
+#define SC_STATS_MAX_AGENTS 32
+#define SC_STATS_SUB_BITS 4
+#define SC_STATS_SUB_BUCKETS (1u << SC_STATS_SUB_BITS)
+#define SC_STATS_MAX_EXPONENT 47 // 2^47 ticks is hours; longer runs land in the last bucket
+#define SC_STATS_BUCKETS ((SC_STATS_MAX_EXPONENT - SC_STATS_SUB_BITS + 2) * SC_STATS_SUB_BUCKETS)
+
+typedef struct {
+    atomic_uint_fast64_t calls;
+    atomic_uint_fast64_t ok;
+    atomic_uint_fast64_t errors;
+    atomic_uint_fast64_t skipped;
+    atomic_uint_fast64_t ticks;    // sum, for the mean
+    atomic_uint_fast64_t max_ticks;
+    atomic_uint_fast64_t buckets[SC_STATS_BUCKETS];
+} sc_stats_slot;
+
+// One per recording thread, never freed so counts of exited threads survive
+typedef struct sc_stats_thread {
+    struct sc_stats_thread* next;
+    _Atomic(sc_stats_slot*) slots[SC_STATS_MAX_AGENTS]; // allocated on first use
+} sc_stats_thread;
+
+typedef struct {
+    const char* name;
+    uint64_t calls;
+    uint64_t ok;
+    uint64_t errors;
+    uint64_t skipped; // runs saved by version checks
+    double mean_ns;
+    double p50_ns;
+    double p90_ns;
+    double p99_ns;
+    double p999_ns;
+    double max_ns;
+} sc_agent_stats;
+
+static atomic_int sc_stats_on;
+static const char* sc_stats_names[SC_STATS_MAX_AGENTS];
+static size_t sc_stats_count;
+static _Atomic(sc_stats_thread*) sc_stats_threads;
+static _Thread_local sc_stats_thread* sc_stats_self;
+static uint64_t sc_stats_epoch_ticks; // calibration point taken by sc_stats_enable
+static uint64_t sc_stats_epoch_ns;
+static volatile sig_atomic_t sc_stats_requested;
+
+static inline uint64_t sc_stats_ticks(void) {
+#if defined(__GNUC__) && defined(__x86_64__)
+    return __rdtsc();
+#else
+    return sc_now_ns();
+#endif
+}
+
+void sc_stats_enable(int enabled) {
+    if (enabled && sc_stats_epoch_ns == 0) {
+        sc_stats_epoch_ticks = sc_stats_ticks();
+        sc_stats_epoch_ns = sc_now_ns();
+    }
+    atomic_store_explicit(&sc_stats_on, enabled, memory_order_relaxed);
+}
+
+// Returns the id for name, registering it on first use. Not thread-safe, like
+// the type registry: register during setup.
+size_t sc_stats_register(const char* name) {
+    for (size_t id = 0; id < sc_stats_count; id++) {
+        if (strcmp(sc_stats_names[id], name) == 0) {
+            return id;
+        }
+    }
+    if (sc_stats_count >= SC_STATS_MAX_AGENTS) {
+        fprintf(stderr, "Too many instrumented agents, cannot register: %s\n", name);
+        exit(EXIT_FAILURE);
+    }
+    sc_stats_names[sc_stats_count] = name;
+    return sc_stats_count++;
+}
+
+static inline size_t sc_stats_bucket(uint64_t ticks) {
+    if (ticks < SC_STATS_SUB_BUCKETS) {
+        return (size_t)ticks;
+    }
+    unsigned exponent = 63u - (unsigned)__builtin_clzll(ticks);
+    if (exponent > SC_STATS_MAX_EXPONENT) {
+        return SC_STATS_BUCKETS - 1;
+    }
+    size_t sub = (size_t)(ticks >> (exponent - SC_STATS_SUB_BITS)) & (SC_STATS_SUB_BUCKETS - 1);
+    return (exponent - SC_STATS_SUB_BITS + 1) * SC_STATS_SUB_BUCKETS + sub;
+}
+
+// Smallest tick count that falls into bucket
+static inline uint64_t sc_stats_bucket_floor(size_t bucket) {
+    if (bucket < SC_STATS_SUB_BUCKETS) {
+        return bucket;
+    }
+    unsigned exponent = (unsigned)(bucket / SC_STATS_SUB_BUCKETS) + SC_STATS_SUB_BITS - 1;
+    return (uint64_t)(SC_STATS_SUB_BUCKETS + bucket % SC_STATS_SUB_BUCKETS) << (exponent - SC_STATS_SUB_BITS);
+}
+
+// Single writer per slot: load and store instead of read-modify-write
+static inline void sc_stats_add(atomic_uint_fast64_t* counter, uint64_t value) {
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + value,
+                          memory_order_relaxed);
+}
+
+static sc_stats_slot* sc_stats_slot_for(size_t id) {
+    sc_stats_thread* self = sc_stats_self;
+    if (self == NULL) {
+        self = calloc(1, sizeof(sc_stats_thread));
+        if (self == NULL) {
+            return NULL;
+        }
+        self->next = atomic_load_explicit(&sc_stats_threads, memory_order_relaxed);
+        while (!atomic_compare_exchange_weak_explicit(&sc_stats_threads, &self->next, self, memory_order_release,
+                                                      memory_order_relaxed)) {
+        }
+        sc_stats_self = self;
+    }
+    sc_stats_slot* slot = atomic_load_explicit(&self->slots[id], memory_order_relaxed);
+    if (slot == NULL) {
+        slot = calloc(1, sizeof(sc_stats_slot));
+        atomic_store_explicit(&self->slots[id], slot, memory_order_release);
+    }
+    return slot;
+}
+
+// Timestamp to pass to sc_stats_end, 0 while disabled
+static inline uint64_t sc_stats_begin(void) {
+    return atomic_load_explicit(&sc_stats_on, memory_order_relaxed) ? sc_stats_ticks() : 0;
+}
+
+static inline void sc_stats_end(size_t id, uint64_t start, sc_result result) {
+    if (start == 0) {
+        return;
+    }
+    uint64_t ticks = sc_stats_ticks() - start;
+    sc_stats_slot* slot = sc_stats_slot_for(id);
+    if (slot == NULL) {
+        return;
+    }
+    sc_stats_add(&slot->calls, 1);
+    sc_stats_add(result == SC_RESULT_OK ? &slot->ok : &slot->errors, 1);
+    sc_stats_add(&slot->ticks, ticks);
+    sc_stats_add(&slot->buckets[sc_stats_bucket(ticks)], 1);
+    if (ticks > atomic_load_explicit(&slot->max_ticks, memory_order_relaxed)) {
+        atomic_store_explicit(&slot->max_ticks, ticks, memory_order_relaxed);
+    }
+}
+
+static inline void sc_stats_skip(size_t id) {
+    if (atomic_load_explicit(&sc_stats_on, memory_order_relaxed)) {
+        sc_stats_slot* slot = sc_stats_slot_for(id);
+        if (slot != NULL) {
+            sc_stats_add(&slot->skipped, 1);
+        }
+    }
+}
+
+static double sc_stats_ns_per_tick(void) {
+#if defined(__GNUC__) && defined(__x86_64__)
+    if (sc_stats_epoch_ns == 0) {
+        return 1.0;
+    }
+    // Calibrated against the monotonic clock over at least a millisecond
+    uint64_t ns;
+    uint64_t ticks;
+    do {
+        ticks = sc_stats_ticks();
+        ns = sc_now_ns();
+    } while (ns - sc_stats_epoch_ns < 1000000);
+    return (double)(ns - sc_stats_epoch_ns) / (double)(ticks - sc_stats_epoch_ticks);
+#else
+    return 1.0;
+#endif
+}
+
+// Sums every thread's counters into out[0 .. returned count), one entry per
+// registered agent. Counts may lag a little while agents are running.
+size_t sc_stats_collect(sc_agent_stats* out, size_t max) {
+    double ns_per_tick = sc_stats_ns_per_tick();
+    size_t count = sc_stats_count < max ? sc_stats_count : max;
+    static uint64_t buckets[SC_STATS_BUCKETS];
+    for (size_t id = 0; id < count; id++) {
+        sc_agent_stats* stats = &out[id];
+        memset(stats, 0, sizeof(*stats));
+        memset(buckets, 0, sizeof(buckets));
+        stats->name = sc_stats_names[id];
+        uint64_t ticks = 0, max_ticks = 0;
+        for (sc_stats_thread* t = atomic_load_explicit(&sc_stats_threads, memory_order_acquire); t != NULL;
+             t = t->next) {
+            sc_stats_slot* slot = atomic_load_explicit(&t->slots[id], memory_order_acquire);
+            if (slot == NULL) {
+                continue;
+            }
+            stats->calls += atomic_load_explicit(&slot->calls, memory_order_relaxed);
+            stats->ok += atomic_load_explicit(&slot->ok, memory_order_relaxed);
+            stats->errors += atomic_load_explicit(&slot->errors, memory_order_relaxed);
+            stats->skipped += atomic_load_explicit(&slot->skipped, memory_order_relaxed);
+            ticks += atomic_load_explicit(&slot->ticks, memory_order_relaxed);
+            uint64_t slot_max = atomic_load_explicit(&slot->max_ticks, memory_order_relaxed);
+            max_ticks = slot_max > max_ticks ? slot_max : max_ticks;
+            for (size_t b = 0; b < SC_STATS_BUCKETS; b++) {
+                buckets[b] += atomic_load_explicit(&slot->buckets[b], memory_order_relaxed);
+            }
+        }
+        if (stats->calls == 0) {
+            continue;
+        }
+        stats->mean_ns = (double)ticks * ns_per_tick / (double)stats->calls;
+        stats->max_ns = (double)max_ticks * ns_per_tick;
+        static const double quantiles[4] = { 0.5, 0.9, 0.99, 0.999 };
+        double* targets[4] = { &stats->p50_ns, &stats->p90_ns, &stats->p99_ns, &stats->p999_ns };
+        uint64_t seen = 0;
+        size_t q = 0;
+        for (size_t b = 0; b < SC_STATS_BUCKETS && q < 4; b++) {
+            seen += buckets[b];
+            while (q < 4 && (double)seen >= quantiles[q] * (double)stats->calls) {
+                *targets[q++] = (double)sc_stats_bucket_floor(b) * ns_per_tick;
+            }
+        }
+    }
+    return count;
+}
+
+void sc_stats_dump(FILE* out) {
+    sc_agent_stats stats[SC_STATS_MAX_AGENTS];
+    size_t count = sc_stats_collect(stats, SC_STATS_MAX_AGENTS);
+    fprintf(out, "%-20s %10s %10s %8s %10s %9s %9s %9s %9s %9s %9s\n", "agent", "calls", "ok", "errors", "skipped",
+            "mean_ns", "p50_ns", "p90_ns", "p99_ns", "p999_ns", "max_ns");
+    for (size_t id = 0; id < count; id++) {
+        fprintf(out, "%-20s %10llu %10llu %8llu %10llu %9.0f %9.0f %9.0f %9.0f %9.0f %9.0f\n", stats[id].name,
+                (unsigned long long)stats[id].calls, (unsigned long long)stats[id].ok,
+                (unsigned long long)stats[id].errors, (unsigned long long)stats[id].skipped, stats[id].mean_ns,
+                stats[id].p50_ns, stats[id].p90_ns, stats[id].p99_ns, stats[id].p999_ns, stats[id].max_ns);
+    }
+    fflush(out);
+}
+
+// Zeroes every counter; only while no agent is running
+void sc_stats_reset(void) {
+    for (sc_stats_thread* t = atomic_load(&sc_stats_threads); t != NULL; t = t->next) {
+        for (size_t id = 0; id < SC_STATS_MAX_AGENTS; id++) {
+            sc_stats_slot* slot = atomic_load(&t->slots[id]);
+            if (slot != NULL) {
+                memset(slot, 0, sizeof(*slot));
+            }
+        }
+    }
+}
+
+static void sc_stats_signal_handler(int signo) {
+    (void)signo;
+    sc_stats_requested = 1;
+}
+
+// SIGUSR1 requests a dump, written to stderr by the next sc_stats_poll()
+void sc_stats_install_signal(void) {
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = sc_stats_signal_handler;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGUSR1, &action, NULL);
+}
+
+static inline void sc_stats_poll(void) {
+    if (sc_stats_requested) {
+        sc_stats_requested = 0;
+        sc_stats_dump(stderr);
+    }
+}
+
+// Checks the bucket math and counts a short run with failures
+int sc_stats_selftest(void) {
+    int errors = 0;
+    for (uint64_t v = 1; v < (1ull << 40); v = v * 3 + 1) {
+        uint64_t floor = sc_stats_bucket_floor(sc_stats_bucket(v));
+        errors += floor > v || (double)(v - floor) > (double)v / SC_STATS_SUB_BUCKETS;
+    }
+    errors += sc_stats_bucket(UINT64_MAX) != SC_STATS_BUCKETS - 1;
+
+    size_t id = sc_stats_register("selftest_stats");
+    sc_stats_reset();
+    sc_stats_enable(1);
+    for (int i = 0; i < 1000; i++) {
+        uint64_t start = sc_stats_begin();
+        sc_stats_end(id, start, i % 10 == 0 ? SC_RESULT_ERROR : SC_RESULT_OK);
+    }
+    sc_stats_skip(id);
+    sc_stats_enable(0);
+    uint64_t start = sc_stats_begin();
+    sc_stats_end(id, start, SC_RESULT_OK); // not counted
+
+    sc_agent_stats stats[SC_STATS_MAX_AGENTS];
+    size_t count = sc_stats_collect(stats, SC_STATS_MAX_AGENTS);
+    errors += id >= count || stats[id].calls != 1000 || stats[id].ok != 900 || stats[id].errors != 100 ||
+              stats[id].skipped != 1 || stats[id].p50_ns > stats[id].p99_ns || stats[id].p99_ns > stats[id].max_ns;
+    printf("%-8s %s (1000 calls, p50 %.0f ns, max %.0f ns of timer overhead)\n", "stats", errors == 0 ? "ok" : "MISMATCH",
+           id < count ? stats[id].p50_ns : 0.0, id < count ? stats[id].max_ns : 0.0);
+    return errors == 0;
+}
+
+// ==================== agent registry ====================
+// Agents declare the SC addresses they read and write. sc_agent_registry_build()
+// derives the dependency DAG once: an agent depends on every earlier-registered
+// agent it conflicts with (write/read, read/write or write/write on the same
+// address), and agents are grouped into levels of mutually independent agents.
+// A run walks the levels in order; agents sharing a level may run on a pool.
+// An agent is skipped when none of the elements it reads has changed version
+// since its last successful run in that context.
+#define SC_AGENT_MAX_IO 4
+#define SC_AGENT_REGISTRY_MAX 32
+
+typedef sc_result (*sc_agent_step_fn)(sc_memory_context* ctx, const sc_addr* reads, const sc_addr* writes);
+
+typedef struct {
+    const char* name;
+    sc_agent_step_fn step;
+    const char* reads[SC_AGENT_MAX_IO];  // NULL-terminated when shorter
+    const char* writes[SC_AGENT_MAX_IO];
+} sc_agent_desc;
+
+// Addresses of one agent resolved in a particular context, plus the versions
+// of its inputs as of its last successful run
+typedef struct {
+    sc_addr reads[SC_AGENT_MAX_IO];
+    sc_addr writes[SC_AGENT_MAX_IO];
+    uint64_t seen[SC_AGENT_MAX_IO];
+    int has_run;
+} sc_agent_binding;
+
+typedef struct {
+    sc_agent_desc agents[SC_AGENT_REGISTRY_MAX];
+    size_t agent_count;
+    size_t order[SC_AGENT_REGISTRY_MAX];           // agents sorted by level, stable
+    size_t level_start[SC_AGENT_REGISTRY_MAX + 1]; // level l is order[level_start[l] .. level_start[l + 1])
+    size_t level_count;
+    size_t stats_id[SC_AGENT_REGISTRY_MAX];        // sc_stats id per agent, by name
+    // Nonzero while the steps share process-wide state that is not
+    // thread-safe, such as a cache; NULL when they never do
+    int (*shares_state)(void);
+} sc_agent_registry;
+
+void sc_agent_registry_init(sc_agent_registry* registry) {
+    memset(registry, 0, sizeof(*registry));
+}
+
+void sc_agent_registry_add(sc_agent_registry* registry, const sc_agent_desc* desc) {
+    if (registry->agent_count >= SC_AGENT_REGISTRY_MAX) {
+        fprintf(stderr, "Too many agents, cannot register: %s\n", desc->name);
+        exit(EXIT_FAILURE);
+    }
+    registry->stats_id[registry->agent_count] = sc_stats_register(desc->name);
+    registry->agents[registry->agent_count++] = *desc;
+}
+
+static int sc_agent_io_overlaps(const char* const* a, const char* const* b) {
+    for (size_t i = 0; i < SC_AGENT_MAX_IO && a[i] != NULL; i++) {
+        for (size_t j = 0; j < SC_AGENT_MAX_IO && b[j] != NULL; j++) {
+            if (strcmp(a[i], b[j]) == 0) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+// Computes the levels; call once after the last sc_agent_registry_add
+void sc_agent_registry_build(sc_agent_registry* registry) {
+    size_t level[SC_AGENT_REGISTRY_MAX];
+    registry->level_count = 0;
+    for (size_t j = 0; j < registry->agent_count; j++) {
+        const sc_agent_desc* later = &registry->agents[j];
+        level[j] = 0;
+        for (size_t i = 0; i < j; i++) {
+            const sc_agent_desc* earlier = &registry->agents[i];
+            if (sc_agent_io_overlaps(earlier->writes, later->reads) ||
+                sc_agent_io_overlaps(earlier->reads, later->writes) ||
+                sc_agent_io_overlaps(earlier->writes, later->writes)) {
+                if (level[i] + 1 > level[j]) {
+                    level[j] = level[i] + 1;
+                }
+            }
+        }
+        if (level[j] + 1 > registry->level_count) {
+            registry->level_count = level[j] + 1;
+        }
+    }
+
+    size_t n = 0;
+    for (size_t l = 0; l < registry->level_count; l++) {
+        registry->level_start[l] = n;
+        for (size_t j = 0; j < registry->agent_count; j++) {
+            if (level[j] == l) {
+                registry->order[n++] = j;
+            }
+        }
+    }
+    registry->level_start[registry->level_count] = n;
+}
+
+// Resolves every declared address in ctx; redo after sc_memory_reset
+void sc_agent_registry_bind(const sc_agent_registry* registry, sc_memory_context* ctx, sc_agent_binding* bindings) {
+    for (size_t a = 0; a < registry->agent_count; a++) {
+        const sc_agent_desc* desc = &registry->agents[a];
+        for (size_t i = 0; i < SC_AGENT_MAX_IO; i++) {
+            bindings[a].reads[i] = desc->reads[i] ? sc_memory_resolve(ctx, desc->reads[i]) : SC_ADDR_EMPTY;
+            bindings[a].writes[i] = desc->writes[i] ? sc_memory_resolve(ctx, desc->writes[i]) : SC_ADDR_EMPTY;
+            bindings[a].seen[i] = 0;
+        }
+        bindings[a].has_run = 0;
+    }
+}
+
+struct sc_agent_state {
+    const sc_agent_registry* registry;
+    sc_agent_binding bindings[SC_AGENT_REGISTRY_MAX];
+};
+
+// Returns bindings for registry kept by ctx itself, so the versions agents saw
+// survive between runs. A context keeps state for one registry at a time.
+sc_agent_binding* sc_agent_registry_bindings(const sc_agent_registry* registry, sc_memory_context* ctx) {
+    if (ctx->agents == NULL) {
+        ctx->agents = malloc(sizeof(struct sc_agent_state));
+        ctx->agents->registry = NULL;
+    }
+    if (ctx->agents->registry != registry) {
+        ctx->agents->registry = registry;
+        sc_agent_registry_bind(registry, ctx, ctx->agents->bindings);
+    }
+    return ctx->agents->bindings;
+}
+
+static int sc_agent_inputs_changed(sc_memory_context* ctx, const sc_agent_binding* binding) {
+    if (!binding->has_run || binding->reads[0] == SC_ADDR_EMPTY) {
+        return 1; // never ran, or nothing to compare: always run
+    }
+    for (size_t i = 0; i < SC_AGENT_MAX_IO && binding->reads[i] != SC_ADDR_EMPTY; i++) {
+        if (sc_memory_version(ctx, binding->reads[i]) != binding->seen[i]) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+typedef struct {
+    const sc_agent_registry* registry;
+    sc_memory_context* ctx;
+    sc_agent_binding* bindings;
+    const size_t* agents;
+    sc_result* results;
+} sc_agent_level_job;
+
+static void sc_agent_level_run(void* arg, size_t begin, size_t end) {
+    sc_agent_level_job* job = arg;
+    for (size_t i = begin; i < end; i++) {
+        size_t a = job->agents[i];
+        sc_agent_binding* binding = &job->bindings[a];
+        uint64_t start = sc_stats_begin();
+        job->results[i] = job->registry->agents[a].step(job->ctx, binding->reads, binding->writes);
+        sc_stats_end(job->registry->stats_id[a], start, job->results[i]);
+        if (job->results[i] == SC_RESULT_OK) {
+            // Versions after the run, so the agent's own in-place writes don't re-trigger it
+            for (size_t k = 0; k < SC_AGENT_MAX_IO && binding->reads[k] != SC_ADDR_EMPTY; k++) {
+                binding->seen[k] = sc_memory_version(job->ctx, binding->reads[k]);
+            }
+            binding->has_run = 1;
+        }
+    }
+}
+
+// Runs the agents level by level and stops after the first level with a
+// failure. Levels with several agents run on pool when one is given; since
+// every written address is resolved up front, those agents only overwrite
+// existing entries. They must keep their stores inline-sized. Levels run
+// serially instead while ctx has event subscriptions or a write-ahead log,
+// or while the registry's shares_state hook says the steps share state.
+sc_result sc_agent_registry_run(const sc_agent_registry* registry, sc_memory_context* ctx,
+                                sc_agent_binding* bindings, sc_thread_pool* pool) {
+    sc_result results[SC_AGENT_REGISTRY_MAX];
+    size_t dirty[SC_AGENT_REGISTRY_MAX];
+    sc_stats_poll();
+    if (ctx->events != NULL || ctx->wal != NULL ||
+        (registry->shares_state != NULL && registry->shares_state())) {
+        pool = NULL;
+    }
+    for (size_t l = 0; l < registry->level_count; l++) {
+        // Decided per level: earlier levels may just have changed our inputs
+        size_t count = 0;
+        for (size_t i = registry->level_start[l]; i < registry->level_start[l + 1]; i++) {
+            if (sc_agent_inputs_changed(ctx, &bindings[registry->order[i]])) {
+                dirty[count++] = registry->order[i];
+            } else {
+                sc_stats_skip(registry->stats_id[registry->order[i]]);
+            }
+        }
+        sc_agent_level_job job = { registry, ctx, bindings, dirty, results };
+        sc_thread_pool_parallel_for(pool, count, 1, sc_agent_level_run, &job);
+        for (size_t i = 0; i < count; i++) {
+            if (results[i] != SC_RESULT_OK) {
+                return SC_RESULT_ERROR;
+            }
+        }
+    }
+    return SC_RESULT_OK;
+}
+
+// ==================== domains ====================
+typedef struct {
+    double value;
+    int is_known;
+} angle;
+
+typedef struct {
+    angle angles[3]; // angles[0] - A, angles[1] - B, angles[2] - C
+} triangle;
+
+// Why a triangle could or could not be completed. Codes are disjoint and OK
+// is 0, so a status array can be filtered with plain byte compares.
+typedef enum {
+    TRIANGLE_OK,                 // exactly one unknown angle, completed
+    TRIANGLE_TOO_MANY_UNKNOWNS,  // two or three unknown angles
+    TRIANGLE_NONE_UNKNOWN,       // nothing to complete
+    TRIANGLE_NON_POSITIVE_ANGLE, // a known angle is <= 0 (or NaN)
+    TRIANGLE_INVALID_SUM,        // the known angles leave nothing for the third
+    TRIANGLE_STATUS_COUNT
+} triangle_status;
+
+static const char* const triangle_status_names[TRIANGLE_STATUS_COUNT] = {
+    "ok", "too_many_unknowns", "none_unknown", "non_positive_angle", "invalid_sum",
+};
+
+// Structure-of-arrays batch of triangles. Capacity is padded to whole 64-lane
+// words so kernels never need a tail loop; padding lanes are never known.
+#define TRIANGLE_BATCH_LANES 64
+
+typedef struct {
+    size_t count;
+    size_t capacity;       // multiple of TRIANGLE_BATCH_LANES
+    double* value[3];      // value[i][j] - angle i of triangle j
+    uint64_t* is_known[3]; // bit j % 64 of word j / 64
+    uint64_t* is_right;    // filled by triangle_batch_detect_right_angles
+    uint8_t* status;       // triangle_status per lane, filled by triangle_batch_complete_angles
+} triangle_batch;
+
+static inline size_t triangle_batch_words(const triangle_batch* batch) {
+    return batch->capacity / TRIANGLE_BATCH_LANES;
+}
+
+// Size of the single block holding all arrays of a batch
+static size_t triangle_batch_bytes(size_t capacity) {
+    size_t words = capacity / TRIANGLE_BATCH_LANES;
+    size_t bytes = 3 * capacity * sizeof(double) + 4 * words * sizeof(uint64_t) + capacity;
+    return (bytes + 63) & ~(size_t)63; // aligned_alloc wants a multiple of the alignment
+}
+
+// Points the arrays of batch into block: three value arrays, the is_known and
+// is_right words, then the status bytes
+static void triangle_batch_layout(triangle_batch* batch, unsigned char* block, size_t capacity) {
+    size_t words = capacity / TRIANGLE_BATCH_LANES;
+    uint64_t* masks = (uint64_t*)(block + 3 * capacity * sizeof(double));
+    batch->capacity = capacity;
+    for (int i = 0; i < 3; i++) {
+        batch->value[i] = (double*)block + i * capacity;
+        batch->is_known[i] = masks + i * words;
+    }
+    batch->is_right = masks + 3 * words;
+    batch->status = (uint8_t*)(masks + 4 * words);
+}
+
+void triangle_batch_init(triangle_batch* batch, size_t capacity) {
+    capacity = (capacity + TRIANGLE_BATCH_LANES - 1) / TRIANGLE_BATCH_LANES * TRIANGLE_BATCH_LANES;
+    if (capacity == 0) {
+        capacity = TRIANGLE_BATCH_LANES;
+    }
+    // One 64-byte aligned block: three value arrays followed by the bitmasks
+    size_t bytes = triangle_batch_bytes(capacity);
+    unsigned char* block = aligned_alloc(64, bytes);
+    if (block == NULL) {
+        fprintf(stderr, "Cannot allocate triangle batch of %zu\n", capacity);
+        exit(EXIT_FAILURE);
+    }
+    memset(block, 0, bytes);
+
+    batch->count = 0;
+    triangle_batch_layout(batch, block, capacity);
+}
+
+void triangle_batch_destroy(triangle_batch* batch) {
+    free(batch->value[0]);
+    memset(batch, 0, sizeof(*batch));
+}
+
+void triangle_batch_set(triangle_batch* batch, size_t j, const triangle* tri) {
+    uint64_t bit = 1ull << (j % TRIANGLE_BATCH_LANES);
+    for (int i = 0; i < 3; i++) {
+        batch->value[i][j] = tri->angles[i].value;
+        if (tri->angles[i].is_known) {
+            batch->is_known[i][j / TRIANGLE_BATCH_LANES] |= bit;
+        } else {
+            batch->is_known[i][j / TRIANGLE_BATCH_LANES] &= ~bit;
+        }
+    }
+}
+
+void triangle_batch_get(const triangle_batch* batch, size_t j, triangle* tri) {
+    for (int i = 0; i < 3; i++) {
+        tri->angles[i].value = batch->value[i][j];
+        tri->angles[i].is_known = (int)((batch->is_known[i][j / TRIANGLE_BATCH_LANES] >> (j % TRIANGLE_BATCH_LANES)) & 1);
+    }
+}
+
+// Empties the batch for refilling; keeps its capacity
+void triangle_batch_clear(triangle_batch* batch) {
+    size_t words = batch->capacity / TRIANGLE_BATCH_LANES;
+    memset(batch->is_known[0], 0, 4 * words * sizeof(uint64_t));
+    batch->count = 0;
+}
+
+// Appends a triangle; returns 0 when the batch is full
+int triangle_batch_push(triangle_batch* batch, const triangle* tri) {
+    if (batch->count >= batch->capacity) {
+        return 0;
+    }
+    triangle_batch_set(batch, batch->count++, tri);
+    return 1;
+}
+
+// Sum of the eight bytes of acc
+static inline size_t triangle_status_sum_bytes(uint64_t acc) {
+    uint64_t pairs = (acc & 0x00FF00FF00FF00FFull) + ((acc >> 8) & 0x00FF00FF00FF00FFull);
+    return (size_t)((pairs * 0x0001000100010001ull) >> 48);
+}
+
+// Adds the number of triangles with each status to counts. Eight status bytes
+// at a time are split into bit planes and summed per byte, flushing before a
+// byte counter can wrap; mapped files hold whatever was written, so a word
+// with a code out of range drops to the checked byte loop.
+void triangle_batch_count_status(const triangle_batch* batch, size_t counts[TRIANGLE_STATUS_COUNT]) {
+    const uint64_t ones = 0x0101010101010101ull;
+    size_t j = 0;
+    int in_range = 1;
+    while (in_range && j + 8 <= batch->count) {
+        uint64_t acc[TRIANGLE_STATUS_COUNT] = { 0 };
+        size_t end = batch->count - j > 255 * 8 ? j + 255 * 8 : batch->count;
+        for (; j + 8 <= end; j += 8) {
+            uint64_t bytes;
+            memcpy(&bytes, batch->status + j, sizeof(bytes));
+            if ((((bytes + ones * (0x80 - TRIANGLE_STATUS_COUNT)) | bytes) & ones * 0x80) != 0) {
+                in_range = 0;
+                break;
+            }
+            uint64_t bit0 = bytes & ones, bit1 = (bytes >> 1) & ones, bit2 = (bytes >> 2) & ones;
+            acc[TRIANGLE_OK] += ones & ~(bit0 | bit1 | bit2);
+            acc[TRIANGLE_TOO_MANY_UNKNOWNS] += bit0 & ~bit1;
+            acc[TRIANGLE_NONE_UNKNOWN] += bit1 & ~bit0;
+            acc[TRIANGLE_NON_POSITIVE_ANGLE] += bit0 & bit1;
+            acc[TRIANGLE_INVALID_SUM] += bit2;
+        }
+        for (int status = 0; status < TRIANGLE_STATUS_COUNT; status++) {
+            counts[status] += triangle_status_sum_bytes(acc[status]);
+        }
+    }
+    for (; j < batch->count; j++) {
+        if (batch->status[j] < TRIANGLE_STATUS_COUNT) {
+            counts[batch->status[j]]++;
+        }
+    }
+}
+
+// ==================== batch kernels ====================
+// Every kernel works on words [word_begin, word_end) of a batch. The SIMD
+// variants must stay bit-exact with the scalar ones, which in turn mirror
+// calculate_angles_agent_execute and check_right_angle_agent_execute: the
+// known angles are summed in index order starting from 0.0, and a lane is
+// right-angled when fabs(value - 90.0) < 0.001 for a known angle.
+typedef struct {
+    const char* name;
+    size_t (*complete_angles)(triangle_batch* batch, size_t word_begin, size_t word_end);
+    size_t (*detect_right_angles)(triangle_batch* batch, size_t word_begin, size_t word_end);
+} triangle_batch_kernels;
+
+#define RIGHT_ANGLE_EPSILON 0.001
+
+// Byte k of TRIANGLE_STATUS_SPREAD[b] is bit k of b (little-endian byte order)
+#define TRIANGLE_STATUS_SPREAD1(b)                                                                       \
+    ((uint64_t)((b) & 1) | (uint64_t)(((b) >> 1) & 1) << 8 | (uint64_t)(((b) >> 2) & 1) << 16 |         \
+     (uint64_t)(((b) >> 3) & 1) << 24 | (uint64_t)(((b) >> 4) & 1) << 32 |                              \
+     (uint64_t)(((b) >> 5) & 1) << 40 | (uint64_t)(((b) >> 6) & 1) << 48 | (uint64_t)(((b) >> 7) & 1) << 56)
+#define TRIANGLE_STATUS_SPREAD4(b)                                                                       \
+    TRIANGLE_STATUS_SPREAD1(b), TRIANGLE_STATUS_SPREAD1(b + 1), TRIANGLE_STATUS_SPREAD1(b + 2),          \
+        TRIANGLE_STATUS_SPREAD1(b + 3)
+#define TRIANGLE_STATUS_SPREAD16(b)                                                                      \
+    TRIANGLE_STATUS_SPREAD4(b), TRIANGLE_STATUS_SPREAD4(b + 4), TRIANGLE_STATUS_SPREAD4(b + 8),          \
+        TRIANGLE_STATUS_SPREAD4(b + 12)
+#define TRIANGLE_STATUS_SPREAD64(b)                                                                      \
+    TRIANGLE_STATUS_SPREAD16(b), TRIANGLE_STATUS_SPREAD16(b + 16), TRIANGLE_STATUS_SPREAD16(b + 32),     \
+        TRIANGLE_STATUS_SPREAD16(b + 48)
+static const uint64_t triangle_status_spread[256] = {
+    TRIANGLE_STATUS_SPREAD64(0), TRIANGLE_STATUS_SPREAD64(64),
+    TRIANGLE_STATUS_SPREAD64(128), TRIANGLE_STATUS_SPREAD64(192),
+};
+
+// One status byte per lane from disjoint lane masks; lanes in none of them are OK
+static inline void triangle_batch_store_status(uint8_t* status, uint64_t too_many, uint64_t none,
+                                               uint64_t non_positive, uint64_t invalid_sum) {
+    // Bit planes of the codes 1-4
+    uint64_t plane0 = too_many | non_positive;
+    uint64_t plane1 = none | non_positive;
+    uint64_t plane2 = invalid_sum;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    for (int lane = 0; lane < TRIANGLE_BATCH_LANES; lane += 8) {
+        uint64_t bytes = triangle_status_spread[(plane0 >> lane) & 0xFF] |
+                         triangle_status_spread[(plane1 >> lane) & 0xFF] << 1 |
+                         triangle_status_spread[(plane2 >> lane) & 0xFF] << 2;
+        memcpy(status + lane, &bytes, sizeof(bytes));
+    }
+#else
+    for (int lane = 0; lane < TRIANGLE_BATCH_LANES; lane++) {
+        status[lane] = (uint8_t)(((plane0 >> lane) & 1) | ((plane1 >> lane) & 1) << 1 | ((plane2 >> lane) & 1) << 2);
+    }
+#endif
+}
+
+// Completes the missing angle of every triangle with exactly one unknown
+// angle whose known angles are positive and sum to less than 180, and
+// records a triangle_status for every lane. Returns the number completed.
+static size_t triangle_batch_complete_angles_scalar(triangle_batch* batch, size_t word_begin, size_t word_end) {
+    size_t completed = 0;
+    for (size_t w = word_begin; w < word_end; w++) {
+        uint64_t k0 = batch->is_known[0][w];
+        uint64_t k1 = batch->is_known[1][w];
+        uint64_t k2 = batch->is_known[2][w];
+        uint64_t missing[3] = { k1 & k2 & ~k0, k0 & k2 & ~k1, k0 & k1 & ~k2 };
+        uint64_t none = k0 & k1 & k2;
+        uint64_t non_positive = 0;
+        uint64_t invalid_sum = 0;
+
+        for (int i = 0; i < 3; i++) {
+            uint64_t lanes = missing[i];
+            while (lanes) {
+                size_t lane = (size_t)__builtin_ctzll(lanes);
+                size_t j = w * TRIANGLE_BATCH_LANES + lane;
+                double sum_known = 0.0;
+                int positive = 1;
+                for (int k = 0; k < 3; k++) {
+                    if (k != i) {
+                        sum_known += batch->value[k][j];
+                        positive &= batch->value[k][j] > 0.0;
+                    }
+                }
+                if (!positive) {
+                    non_positive |= 1ull << lane;
+                } else if (!(180.0 - sum_known > 0.0)) {
+                    invalid_sum |= 1ull << lane;
+                } else {
+                    batch->value[i][j] = 180.0 - sum_known;
+                }
+                lanes &= lanes - 1;
+            }
+            uint64_t valid = missing[i] & ~(non_positive | invalid_sum);
+            batch->is_known[i][w] |= valid;
+            completed += (size_t)__builtin_popcountll(valid);
+        }
+        triangle_batch_store_status(batch->status + w * TRIANGLE_BATCH_LANES,
+                                    ~(missing[0] | missing[1] | missing[2] | none), none, non_positive, invalid_sum);
+    }
+    return completed;
+}
+
+static size_t triangle_batch_detect_right_angles_scalar(triangle_batch* batch, size_t word_begin, size_t word_end) {
+    size_t right = 0;
+    for (size_t w = word_begin; w < word_end; w++) {
+        uint64_t mask = 0;
+        for (int i = 0; i < 3; i++) {
+            uint64_t lanes = batch->is_known[i][w];
+            const double* value = batch->value[i] + w * TRIANGLE_BATCH_LANES;
+            uint64_t hits = 0;
+            for (int lane = 0; lane < TRIANGLE_BATCH_LANES; lane++) {
+                hits |= (uint64_t)(fabs(value[lane] - 90.0) < RIGHT_ANGLE_EPSILON) << lane;
+            }
+            mask |= hits & lanes;
+        }
+        batch->is_right[w] = mask;
+        right += (size_t)__builtin_popcountll(mask);
+    }
+    return right;
+}
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define TRIANGLE_BATCH_X86_KERNELS 1
+
+// --- SSE2: 2 lanes ---
+__attribute__((target("sse2")))
+static inline __m128d sse2_lane_mask(uint64_t bits) {
+    return _mm_castsi128_pd(_mm_set_epi64x(-(long long)((bits >> 1) & 1), -(long long)(bits & 1)));
+}
+
+__attribute__((target("sse2")))
+static inline __m128d sse2_blend(__m128d a, __m128d b, __m128d mask) {
+    return _mm_or_pd(_mm_and_pd(mask, b), _mm_andnot_pd(mask, a));
+}
+
+__attribute__((target("sse2")))
+static size_t triangle_batch_complete_angles_sse2(triangle_batch* batch, size_t word_begin, size_t word_end) {
+    const __m128d straight = _mm_set1_pd(180.0);
+    const __m128d zero = _mm_setzero_pd();
+    size_t completed = 0;
+    for (size_t w = word_begin; w < word_end; w++) {
+        uint64_t k0 = batch->is_known[0][w];
+        uint64_t k1 = batch->is_known[1][w];
+        uint64_t k2 = batch->is_known[2][w];
+        uint64_t m0 = k1 & k2 & ~k0, m1 = k0 & k2 & ~k1, m2 = k0 & k1 & ~k2;
+        uint64_t any = m0 | m1 | m2;
+        uint64_t none = k0 & k1 & k2;
+        uint64_t non_positive = 0;
+        uint64_t invalid_sum = 0;
+        uint8_t* status = batch->status + w * TRIANGLE_BATCH_LANES;
+        if (any == 0) {
+            triangle_batch_store_status(status, ~none, none, 0, 0);
+            continue;
+        }
+
+        size_t base = w * TRIANGLE_BATCH_LANES;
+        for (int lane = 0; lane < TRIANGLE_BATCH_LANES; lane += 2) {
+            if (((any >> lane) & 3) == 0) {
+                continue;
+            }
+            __m128d v0 = _mm_load_pd(batch->value[0] + base + lane);
+            __m128d v1 = _mm_load_pd(batch->value[1] + base + lane);
+            __m128d v2 = _mm_load_pd(batch->value[2] + base + lane);
+            __m128d sum = _mm_setzero_pd();
+            sum = _mm_add_pd(sum, _mm_and_pd(v0, sse2_lane_mask(k0 >> lane)));
+            sum = _mm_add_pd(sum, _mm_and_pd(v1, sse2_lane_mask(k1 >> lane)));
+            sum = _mm_add_pd(sum, _mm_and_pd(v2, sse2_lane_mask(k2 >> lane)));
+            __m128d fill = _mm_sub_pd(straight, sum);
+            uint64_t lanes = (any >> lane) & 3;
+            uint64_t positive = ((uint64_t)_mm_movemask_pd(_mm_cmpgt_pd(v0, zero)) | ~(k0 >> lane)) &
+                                ((uint64_t)_mm_movemask_pd(_mm_cmpgt_pd(v1, zero)) | ~(k1 >> lane)) &
+                                ((uint64_t)_mm_movemask_pd(_mm_cmpgt_pd(v2, zero)) | ~(k2 >> lane));
+            uint64_t bad_angle = lanes & ~positive;
+            uint64_t bad_sum = lanes & positive & ~(uint64_t)_mm_movemask_pd(_mm_cmpgt_pd(fill, zero));
+            uint64_t valid = lanes & ~(bad_angle | bad_sum);
+            non_positive |= bad_angle << lane;
+            invalid_sum |= bad_sum << lane;
+            _mm_store_pd(batch->value[0] + base + lane, sse2_blend(v0, fill, sse2_lane_mask((m0 >> lane) & valid)));
+            _mm_store_pd(batch->value[1] + base + lane, sse2_blend(v1, fill, sse2_lane_mask((m1 >> lane) & valid)));
+            _mm_store_pd(batch->value[2] + base + lane, sse2_blend(v2, fill, sse2_lane_mask((m2 >> lane) & valid)));
+        }
+        uint64_t valid = any & ~(non_positive | invalid_sum);
+        batch->is_known[0][w] = k0 | (m0 & valid);
+        batch->is_known[1][w] = k1 | (m1 & valid);
+        batch->is_known[2][w] = k2 | (m2 & valid);
+        completed += (size_t)__builtin_popcountll(valid);
+        triangle_batch_store_status(status, ~(any | none), none, non_positive, invalid_sum);
+    }
+    return completed;
+}
+
+__attribute__((target("sse2")))
+static size_t triangle_batch_detect_right_angles_sse2(triangle_batch* batch, size_t word_begin, size_t word_end) {
+    const __m128d ninety = _mm_set1_pd(90.0);
+    const __m128d epsilon = _mm_set1_pd(RIGHT_ANGLE_EPSILON);
+    const __m128d abs_mask = _mm_castsi128_pd(_mm_set1_epi64x(0x7fffffffffffffffLL));
+    size_t right = 0;
+    for (size_t w = word_begin; w < word_end; w++) {
+        size_t base = w * TRIANGLE_BATCH_LANES;
+        uint64_t mask = 0;
+        for (int i = 0; i < 3; i++) {
+            uint64_t hits = 0;
+            for (int lane = 0; lane < TRIANGLE_BATCH_LANES; lane += 2) {
+                __m128d v = _mm_load_pd(batch->value[i] + base + lane);
+                __m128d diff = _mm_and_pd(_mm_sub_pd(v, ninety), abs_mask);
+                hits |= (uint64_t)_mm_movemask_pd(_mm_cmplt_pd(diff, epsilon)) << lane;
+            }
+            mask |= hits & batch->is_known[i][w];
+        }
+        batch->is_right[w] = mask;
+        right += (size_t)__builtin_popcountll(mask);
+    }
+    return right;
+}
+
+// --- AVX2: 4 lanes ---
+__attribute__((target("avx2")))
+static inline __m256d avx2_lane_mask(uint64_t bits) {
+    const __m256i select = _mm256_setr_epi64x(1, 2, 4, 8);
+    __m256i spread = _mm256_and_si256(_mm256_set1_epi64x((long long)(bits & 0xF)), select);
+    return _mm256_castsi256_pd(_mm256_cmpeq_epi64(spread, select));
+}
+
+__attribute__((target("avx2")))
+static size_t triangle_batch_complete_angles_avx2(triangle_batch* batch, size_t word_begin, size_t word_end) {
+    const __m256d straight = _mm256_set1_pd(180.0);
+    const __m256d zero = _mm256_setzero_pd();
+    size_t completed = 0;
+    for (size_t w = word_begin; w < word_end; w++) {
+        uint64_t k0 = batch->is_known[0][w];
+        uint64_t k1 = batch->is_known[1][w];
+        uint64_t k2 = batch->is_known[2][w];
+        uint64_t m0 = k1 & k2 & ~k0, m1 = k0 & k2 & ~k1, m2 = k0 & k1 & ~k2;
+        uint64_t any = m0 | m1 | m2;
+        uint64_t none = k0 & k1 & k2;
+        uint64_t non_positive = 0;
+        uint64_t invalid_sum = 0;
+        uint8_t* status = batch->status + w * TRIANGLE_BATCH_LANES;
+        if (any == 0) {
+            triangle_batch_store_status(status, ~none, none, 0, 0);
+            continue;
+        }
+
+        size_t base = w * TRIANGLE_BATCH_LANES;
+        for (int lane = 0; lane < TRIANGLE_BATCH_LANES; lane += 4) {
+            if (((any >> lane) & 0xF) == 0) {
+                continue;
+            }
+            __m256d v0 = _mm256_load_pd(batch->value[0] + base + lane);
+            __m256d v1 = _mm256_load_pd(batch->value[1] + base + lane);
+            __m256d v2 = _mm256_load_pd(batch->value[2] + base + lane);
+            __m256d sum = _mm256_setzero_pd();
+            sum = _mm256_add_pd(sum, _mm256_and_pd(v0, avx2_lane_mask(k0 >> lane)));
+            sum = _mm256_add_pd(sum, _mm256_and_pd(v1, avx2_lane_mask(k1 >> lane)));
+            sum = _mm256_add_pd(sum, _mm256_and_pd(v2, avx2_lane_mask(k2 >> lane)));
+            __m256d fill = _mm256_sub_pd(straight, sum);
+            uint64_t lanes = (any >> lane) & 0xF;
+            uint64_t positive = ((uint64_t)_mm256_movemask_pd(_mm256_cmp_pd(v0, zero, _CMP_GT_OQ)) | ~(k0 >> lane)) &
+                                ((uint64_t)_mm256_movemask_pd(_mm256_cmp_pd(v1, zero, _CMP_GT_OQ)) | ~(k1 >> lane)) &
+                                ((uint64_t)_mm256_movemask_pd(_mm256_cmp_pd(v2, zero, _CMP_GT_OQ)) | ~(k2 >> lane));
+            uint64_t bad_angle = lanes & ~positive;
+            uint64_t bad_sum = lanes & positive & ~(uint64_t)_mm256_movemask_pd(_mm256_cmp_pd(fill, zero, _CMP_GT_OQ));
+            uint64_t valid = lanes & ~(bad_angle | bad_sum);
+            non_positive |= bad_angle << lane;
+            invalid_sum |= bad_sum << lane;
+            _mm256_store_pd(batch->value[0] + base + lane,
+                            _mm256_blendv_pd(v0, fill, avx2_lane_mask((m0 >> lane) & valid)));
+            _mm256_store_pd(batch->value[1] + base + lane,
+                            _mm256_blendv_pd(v1, fill, avx2_lane_mask((m1 >> lane) & valid)));
+            _mm256_store_pd(batch->value[2] + base + lane,
+                            _mm256_blendv_pd(v2, fill, avx2_lane_mask((m2 >> lane) & valid)));
+        }
+        uint64_t valid = any & ~(non_positive | invalid_sum);
+        batch->is_known[0][w] = k0 | (m0 & valid);
+        batch->is_known[1][w] = k1 | (m1 & valid);
+        batch->is_known[2][w] = k2 | (m2 & valid);
+        completed += (size_t)__builtin_popcountll(valid);
+        triangle_batch_store_status(status, ~(any | none), none, non_positive, invalid_sum);
+    }
+    return completed;
+}
+
+__attribute__((target("avx2")))
+static size_t triangle_batch_detect_right_angles_avx2(triangle_batch* batch, size_t word_begin, size_t word_end) {
+    const __m256d ninety = _mm256_set1_pd(90.0);
+    const __m256d epsilon = _mm256_set1_pd(RIGHT_ANGLE_EPSILON);
+    const __m256d abs_mask = _mm256_castsi256_pd(_mm256_set1_epi64x(0x7fffffffffffffffLL));
+    size_t right = 0;
+    for (size_t w = word_begin; w < word_end; w++) {
+        size_t base = w * TRIANGLE_BATCH_LANES;
+        uint64_t mask = 0;
+        for (int i = 0; i < 3; i++) {
+            uint64_t hits = 0;
+            for (int lane = 0; lane < TRIANGLE_BATCH_LANES; lane += 4) {
+                __m256d v = _mm256_load_pd(batch->value[i] + base + lane);
+                __m256d diff = _mm256_and_pd(_mm256_sub_pd(v, ninety), abs_mask);
+                hits |= (uint64_t)_mm256_movemask_pd(_mm256_cmp_pd(diff, epsilon, _CMP_LT_OQ)) << lane;
+            }
+            mask |= hits & batch->is_known[i][w];
+        }
+        batch->is_right[w] = mask;
+        right += (size_t)__builtin_popcountll(mask);
+    }
+    return right;
+}
+
+// --- AVX-512: 8 lanes, blends straight from the bitmasks ---
+__attribute__((target("avx512f")))
+static size_t triangle_batch_complete_angles_avx512(triangle_batch* batch, size_t word_begin, size_t word_end) {
+    const __m512d straight = _mm512_set1_pd(180.0);
+    const __m512d zero = _mm512_setzero_pd();
+    size_t completed = 0;
+    for (size_t w = word_begin; w < word_end; w++) {
+        uint64_t k0 = batch->is_known[0][w];
+        uint64_t k1 = batch->is_known[1][w];
+        uint64_t k2 = batch->is_known[2][w];
+        uint64_t m0 = k1 & k2 & ~k0, m1 = k0 & k2 & ~k1, m2 = k0 & k1 & ~k2;
+        uint64_t any = m0 | m1 | m2;
+        uint64_t none = k0 & k1 & k2;
+        uint64_t non_positive = 0;
+        uint64_t invalid_sum = 0;
+        uint8_t* status = batch->status + w * TRIANGLE_BATCH_LANES;
+        if (any == 0) {
+            triangle_batch_store_status(status, ~none, none, 0, 0);
+            continue;
+        }
+
+        size_t base = w * TRIANGLE_BATCH_LANES;
+        for (int lane = 0; lane < TRIANGLE_BATCH_LANES; lane += 8) {
+            if (((any >> lane) & 0xFF) == 0) {
+                continue;
+            }
+            __m512d v0 = _mm512_load_pd(batch->value[0] + base + lane);
+            __m512d v1 = _mm512_load_pd(batch->value[1] + base + lane);
+            __m512d v2 = _mm512_load_pd(batch->value[2] + base + lane);
+            __m512d sum = _mm512_setzero_pd();
+            sum = _mm512_add_pd(sum, _mm512_maskz_mov_pd((__mmask8)(k0 >> lane), v0));
+            sum = _mm512_add_pd(sum, _mm512_maskz_mov_pd((__mmask8)(k1 >> lane), v1));
+            sum = _mm512_add_pd(sum, _mm512_maskz_mov_pd((__mmask8)(k2 >> lane), v2));
+            __m512d fill = _mm512_sub_pd(straight, sum);
+            __mmask8 lanes = (__mmask8)(any >> lane);
+            __mmask8 bad_angle = _mm512_mask_cmp_pd_mask(lanes & (__mmask8)(k0 >> lane), v0, zero, _CMP_NGT_UQ) |
+                                 _mm512_mask_cmp_pd_mask(lanes & (__mmask8)(k1 >> lane), v1, zero, _CMP_NGT_UQ) |
+                                 _mm512_mask_cmp_pd_mask(lanes & (__mmask8)(k2 >> lane), v2, zero, _CMP_NGT_UQ);
+            __mmask8 bad_sum = _mm512_mask_cmp_pd_mask(lanes & ~bad_angle, fill, zero, _CMP_NGT_UQ);
+            __mmask8 valid = lanes & ~(bad_angle | bad_sum);
+            non_positive |= (uint64_t)bad_angle << lane;
+            invalid_sum |= (uint64_t)bad_sum << lane;
+            _mm512_store_pd(batch->value[0] + base + lane,
+                            _mm512_mask_mov_pd(v0, (__mmask8)((m0 >> lane) & valid), fill));
+            _mm512_store_pd(batch->value[1] + base + lane,
+                            _mm512_mask_mov_pd(v1, (__mmask8)((m1 >> lane) & valid), fill));
+            _mm512_store_pd(batch->value[2] + base + lane,
+                            _mm512_mask_mov_pd(v2, (__mmask8)((m2 >> lane) & valid), fill));
+        }
+        uint64_t valid = any & ~(non_positive | invalid_sum);
+        batch->is_known[0][w] = k0 | (m0 & valid);
+        batch->is_known[1][w] = k1 | (m1 & valid);
+        batch->is_known[2][w] = k2 | (m2 & valid);
+        completed += (size_t)__builtin_popcountll(valid);
+        triangle_batch_store_status(status, ~(any | none), none, non_positive, invalid_sum);
+    }
+    return completed;
+}
+
+__attribute__((target("avx512f")))
+static size_t triangle_batch_detect_right_angles_avx512(triangle_batch* batch, size_t word_begin, size_t word_end) {
+    const __m512d ninety = _mm512_set1_pd(90.0);
+    const __m512d epsilon = _mm512_set1_pd(RIGHT_ANGLE_EPSILON);
+    size_t right = 0;
+    for (size_t w = word_begin; w < word_end; w++) {
+        size_t base = w * TRIANGLE_BATCH_LANES;
+        uint64_t mask = 0;
+        for (int i = 0; i < 3; i++) {
+            uint64_t hits = 0;
+            for (int lane = 0; lane < TRIANGLE_BATCH_LANES; lane += 8) {
+                __m512d v = _mm512_load_pd(batch->value[i] + base + lane);
+                __m512d diff = _mm512_abs_pd(_mm512_sub_pd(v, ninety));
+                hits |= (uint64_t)_mm512_cmp_pd_mask(diff, epsilon, _CMP_LT_OQ) << lane;
+            }
+            mask |= hits & batch->is_known[i][w];
+        }
+        batch->is_right[w] = mask;
+        right += (size_t)__builtin_popcountll(mask);
+    }
+    return right;
+}
+#endif
+
+// Fastest first; the scalar entry is the reference and always last
+static const triangle_batch_kernels triangle_batch_kernel_table[] = {
+#ifdef TRIANGLE_BATCH_X86_KERNELS
+    { "avx512", triangle_batch_complete_angles_avx512, triangle_batch_detect_right_angles_avx512 },
+    { "avx2", triangle_batch_complete_angles_avx2, triangle_batch_detect_right_angles_avx2 },
+    { "sse2", triangle_batch_complete_angles_sse2, triangle_batch_detect_right_angles_sse2 },
+#endif
+    { "scalar", triangle_batch_complete_angles_scalar, triangle_batch_detect_right_angles_scalar },
+};
+#define TRIANGLE_BATCH_KERNEL_COUNT (sizeof(triangle_batch_kernel_table) / sizeof(triangle_batch_kernel_table[0]))
+
+static const triangle_batch_kernels* triangle_kernels = &triangle_batch_kernel_table[TRIANGLE_BATCH_KERNEL_COUNT - 1];
+
+static int triangle_batch_kernels_supported(const triangle_batch_kernels* kernels) {
+#ifdef TRIANGLE_BATCH_X86_KERNELS
+    if (strcmp(kernels->name, "avx512") == 0) {
+        return __builtin_cpu_supports("avx512f");
+    }
+    if (strcmp(kernels->name, "avx2") == 0) {
+        return __builtin_cpu_supports("avx2");
+    }
+    if (strcmp(kernels->name, "sse2") == 0) {
+        return __builtin_cpu_supports("sse2");
+    }
+#endif
+    (void)kernels;
+    return 1;
+}
+
+// Picks the best kernels for this CPU; TRIANGLE_KERNELS=<name> forces a set
+void triangle_batch_kernels_select(void) {
+#ifdef TRIANGLE_BATCH_X86_KERNELS
+    __builtin_cpu_init();
+#endif
+    const char* forced = getenv("TRIANGLE_KERNELS");
+    for (size_t k = 0; k < TRIANGLE_BATCH_KERNEL_COUNT; k++) {
+        const triangle_batch_kernels* kernels = &triangle_batch_kernel_table[k];
+        if (forced != NULL && strcmp(forced, kernels->name) != 0) {
+            continue;
+        }
+        if (triangle_batch_kernels_supported(kernels)) {
+            triangle_kernels = kernels;
+            return;
+        }
+    }
+    if (forced != NULL) {
+        fprintf(stderr, "Triangle kernels '%s' unavailable, using %s\n", forced, triangle_kernels->name);
+    }
+}
+
+const char* triangle_batch_kernels_name(void) {
+    return triangle_kernels->name;
+}
+
+size_t triangle_batch_complete_angles(triangle_batch* batch, size_t word_begin, size_t word_end) {
+    return triangle_kernels->complete_angles(batch, word_begin, word_end);
+}
+
+size_t triangle_batch_detect_right_angles(triangle_batch* batch, size_t word_begin, size_t word_end) {
+    return triangle_kernels->detect_right_angles(batch, word_begin, word_end);
+}
+
+// Runs every supported kernel set on the same random batch and checks the
+// results are bit-identical to the scalar reference. Returns 1 on success.
+int triangle_batch_kernels_selftest(void) {
+    static const double samples[] = { 90.0, 45.0, 60.0, 30.0, 89.999, 90.001, 89.9990001, 90.0009999,
+                                      0.0, -0.0, -90.0, 180.0, 1e-300, 1e300, 120.5, 0.1 };
+    const size_t count = 64 * TRIANGLE_BATCH_LANES - 5; // leave some padding lanes
+    triangle_batch reference;
+    triangle_batch_init(&reference, count);
+
+    uint64_t state = 0x9e3779b97f4a7c15ull;
+    for (size_t j = 0; j < count; j++) {
+        triangle tri;
+        for (int i = 0; i < 3; i++) {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            tri.angles[i].value = (state & 1) ? samples[(state >> 1) % 16] : (double)(state >> 11) / (1ull << 46);
+            tri.angles[i].is_known = ((state >> 8) & 3) != 0;
+        }
+        triangle_batch_push(&reference, &tri);
+    }
+
+    size_t bytes = triangle_batch_bytes(reference.capacity);
+    triangle_batch expected;
+    triangle_batch_init(&expected, count);
+    memcpy(expected.value[0], reference.value[0], bytes);
+    const triangle_batch_kernels* scalar = &triangle_batch_kernel_table[TRIANGLE_BATCH_KERNEL_COUNT - 1];
+    size_t expected_completed = scalar->complete_angles(&expected, 0, triangle_batch_words(&expected));
+    size_t expected_right = scalar->detect_right_angles(&expected, 0, triangle_batch_words(&expected));
+
+    int ok = 1;
+    for (size_t k = 0; k + 1 < TRIANGLE_BATCH_KERNEL_COUNT; k++) {
+        const triangle_batch_kernels* kernels = &triangle_batch_kernel_table[k];
+        if (!triangle_batch_kernels_supported(kernels)) {
+            printf("%-8s skipped (unsupported CPU)\n", kernels->name);
+            continue;
+        }
+        triangle_batch actual;
+        triangle_batch_init(&actual, count);
+        memcpy(actual.value[0], reference.value[0], bytes);
+        size_t completed = kernels->complete_angles(&actual, 0, triangle_batch_words(&actual));
+        size_t right = kernels->detect_right_angles(&actual, 0, triangle_batch_words(&actual));
+        int same = completed == expected_completed && right == expected_right &&
+                   memcmp(actual.value[0], expected.value[0], bytes) == 0;
+        printf("%-8s %s (%zu completed, %zu right-angled)\n", kernels->name, same ? "ok" : "MISMATCH", completed, right);
+        ok &= same;
+        triangle_batch_destroy(&actual);
+    }
+
+    triangle_batch_destroy(&expected);
+    triangle_batch_destroy(&reference);
+    return ok;
+}
+
+// Type ids of the domain SC elements, set by triangle_domain_init()
+static sc_type_id sc_type_triangle;
+static sc_type_id sc_type_int;
+static sc_type_id sc_type_rules_set;
+static sc_type_id sc_type_triangle_batch;
+static size_t triangle_batch_stats_id; // the batch agent is not in the registry
+
+static void triangle_pipeline_build(void);
+
+static void triangle_print(FILE* out, const void* value, size_t size) {
+    (void)size;
+    const triangle* tri = value;
+    fprintf(out, "Triangle(");
+    for (int j = 0; j < 3; j++) {
+        fprintf(out, tri->angles[j].is_known ? "%.2f " : "? ", tri->angles[j].value);
+    }
+    fprintf(out, ")");
+}
+
+// Field by field: brace-initialised triangles leave the padding after each
+// is_known unspecified. Values compare bitwise, as memcmp did.
+static int triangle_equal(const void* stored, const void* value, size_t size) {
+    (void)size;
+    const triangle* a = stored;
+    const triangle* b = value;
+    for (int j = 0; j < 3; j++) {
+        if (a->angles[j].is_known != b->angles[j].is_known ||
+            memcmp(&a->angles[j].value, &b->angles[j].value, sizeof(double)) != 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// The domain only stores flags in int elements
+static void int_flag_print(FILE* out, const void* value, size_t size) {
+    (void)size;
+    fprintf(out, *(const int*)value ? "true" : "false");
+}
+
+static void rules_set_print(FILE* out, const void* value, size_t size) {
+    (void)value;
+    (void)size;
+    fprintf(out, "RulesSet");
+}
+
+static void triangle_batch_print(FILE* out, const void* value, size_t size) {
+    (void)size;
+    fprintf(out, "TriangleBatch(%zu)", ((const triangle_batch*)value)->count);
+}
+
+void triangle_domain_init(void) {
+    sc_type_triangle = sc_type_register("triangle", sizeof(triangle));
+    sc_type_set_ops(sc_type_triangle, &(sc_type_ops){ .print = triangle_print, .equal = triangle_equal });
+    sc_type_int = sc_type_register("int", sizeof(int));
+    sc_type_set_ops(sc_type_int, &(sc_type_ops){ .print = int_flag_print });
+    sc_type_rules_set = sc_type_register("rules_set", 0); // marker element, no payload
+    sc_type_set_ops(sc_type_rules_set, &(sc_type_ops){ .print = rules_set_print });
+    // Only the batch header is copied into SC memory; the arrays stay with their owner
+    sc_type_triangle_batch = sc_type_register("triangle_batch", sizeof(triangle_batch));
+    sc_type_set_ops(sc_type_triangle_batch, &(sc_type_ops){ .print = triangle_batch_print });
+    sc_type_set_transient(sc_type_triangle_batch);
+    triangle_batch_kernels_select();
+    triangle_pipeline_build();
+    triangle_batch_stats_id = sc_stats_register("triangle_batch");
+}
+
+// ==================== triangle memo ====================
+// Bounded cache of single-triangle results in front of the calculate and
+// check agents, so recurring triples (45/45/90, 60/60/60, ...) skip the
+// computation. Buckets are picked by the input angles quantized to
+// TRIANGLE_MEMO_QUANTUM, but an entry is only reused for bit-identical
+// known angles: two inputs in one quantum can still fall on either side of
+// the right-angle epsilon or the 180 degree sum. Replacement is CLOCK. Like
+// the type registry the cache is process-wide and not thread-safe.
+#define TRIANGLE_MEMO_DEFAULT_CAPACITY 1024
+#define TRIANGLE_MEMO_QUANTUM 1e-6    // degrees
+#define TRIANGLE_MEMO_MAX_ANGLE 1e9   // larger (or non-finite) angles bypass the cache
+#define TRIANGLE_MEMO_UNKNOWN INT64_MIN
+#define TRIANGLE_MEMO_NIL UINT32_MAX
+
+typedef struct {
+    triangle input;         // as classified; unknown angles' values are ignored
+    uint32_t hash;          // of the quantized angles
+    uint32_t next;          // bucket chain
+    int referenced;         // CLOCK bit, set on every hit
+    sc_result calculated;   // outcome of completing the unknown angle
+    triangle_status status; // and why
+    int is_right;           // check_right_angle's answer: known input angles only
+    int completed_is_right; // the same test on the completed triangle
+    triangle completed;
+} triangle_memo_entry;
+
+typedef struct {
+    size_t capacity;        // 0 disables the cache
+    size_t count;
+    size_t hand;
+    size_t bucket_mask;
+    triangle_memo_entry* entries; // allocated on first lookup
+    uint32_t* buckets;
+    uint64_t hits;
+    uint64_t misses;
+} triangle_memo;
+
+static triangle_memo triangle_memo_cache = { TRIANGLE_MEMO_DEFAULT_CAPACITY, 0, 0, 0, NULL, NULL, 0, 0 };
+
+// Drops all cached results and counters; capacity 0 disables the cache
+void triangle_memo_configure(size_t capacity) {
+    free(triangle_memo_cache.entries);
+    free(triangle_memo_cache.buckets);
+    memset(&triangle_memo_cache, 0, sizeof(triangle_memo_cache));
+    triangle_memo_cache.capacity = capacity < TRIANGLE_MEMO_NIL ? capacity : TRIANGLE_MEMO_NIL - 1;
+}
+
+// Whether lookups go through the (unlocked) cache
+static int triangle_memo_enabled(void) {
+    return triangle_memo_cache.capacity != 0;
+}
+
+void triangle_memo_stats(uint64_t* hits, uint64_t* misses) {
+    *hits = triangle_memo_cache.hits;
+    *misses = triangle_memo_cache.misses;
+}
+
+// Whether a known angle of tri is within RIGHT_ANGLE_EPSILON of 90 degrees
+static int triangle_has_right_angle(const triangle* tri) {
+    for (int i = 0; i < 3; i++) {
+        if (tri->angles[i].is_known && fabs(tri->angles[i].value - 90.0) < RIGHT_ANGLE_EPSILON) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// What both agents would compute for tri
+static void triangle_classify(const triangle* tri, triangle_memo_entry* out) {
+    int unknown_count = 0;
+    int unknown = 0;
+    int positive = 1;
+    double sum_known = 0.0;
+    for (int i = 0; i < 3; i++) {
+        if (tri->angles[i].is_known) {
+            sum_known += tri->angles[i].value;
+            positive &= tri->angles[i].value > 0.0;
+        } else {
+            unknown = i;
+            unknown_count++;
+        }
+    }
+
+    // Same checks, in the same order, as the batch kernels
+    out->completed = *tri;
+    out->status = unknown_count > 1 ? TRIANGLE_TOO_MANY_UNKNOWNS
+                  : unknown_count == 0 ? TRIANGLE_NONE_UNKNOWN
+                  : !positive ? TRIANGLE_NON_POSITIVE_ANGLE
+                  : !(180.0 - sum_known > 0.0) ? TRIANGLE_INVALID_SUM
+                  : TRIANGLE_OK;
+    out->calculated = out->status == TRIANGLE_OK ? SC_RESULT_OK : SC_RESULT_ERROR;
+    if (out->status == TRIANGLE_OK) {
+        out->completed.angles[unknown].value = 180.0 - sum_known;
+        out->completed.angles[unknown].is_known = 1;
+    }
+
+    out->is_right = triangle_has_right_angle(tri);
+    out->completed_is_right = triangle_has_right_angle(&out->completed);
+}
+
+static int triangle_memo_key(const triangle* tri, int64_t key[3]) {
+    for (int i = 0; i < 3; i++) {
+        double value = tri->angles[i].value;
+        if (!tri->angles[i].is_known) {
+            key[i] = TRIANGLE_MEMO_UNKNOWN;
+        } else if (fabs(value) <= TRIANGLE_MEMO_MAX_ANGLE) {
+            key[i] = llround(value / TRIANGLE_MEMO_QUANTUM);
+        } else {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Whether tri has the same known angles, bit for bit, as a cached input
+static int triangle_memo_same_input(const triangle* cached, const triangle* tri) {
+    for (int i = 0; i < 3; i++) {
+        if (cached->angles[i].is_known != tri->angles[i].is_known ||
+            (tri->angles[i].is_known &&
+             memcmp(&cached->angles[i].value, &tri->angles[i].value, sizeof(double)) != 0)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static uint32_t triangle_memo_hash(const int64_t key[3]) {
+    uint64_t h = 0;
+    for (int i = 0; i < 3; i++) {
+        h = (h ^ (uint64_t)key[i]) * 0x9e3779b97f4a7c15ull;
+        h ^= h >> 29;
+    }
+    return (uint32_t)(h >> 32);
+}
+
+static void triangle_memo_unlink(triangle_memo* memo, uint32_t slot) {
+    uint32_t* link = &memo->buckets[memo->entries[slot].hash & memo->bucket_mask];
+    while (*link != slot) {
+        link = &memo->entries[*link].next;
+    }
+    *link = memo->entries[slot].next;
+}
+
+// Returns the cached result for tri, computing and caching it on a miss.
+// Falls back to classifying into scratch when the cache is off or tri has no key.
+static const triangle_memo_entry* triangle_memo_lookup(const triangle* tri, triangle_memo_entry* scratch) {
+    triangle_memo* memo = &triangle_memo_cache;
+    int64_t key[3];
+    if (memo->capacity == 0 || !triangle_memo_key(tri, key)) {
+        triangle_classify(tri, scratch);
+        return scratch;
+    }
+
+    if (memo->entries == NULL) {
+        size_t buckets = 1;
+        while (buckets < memo->capacity) {
+            buckets *= 2;
+        }
+        memo->entries = malloc(memo->capacity * sizeof(triangle_memo_entry));
+        memo->buckets = malloc(buckets * sizeof(uint32_t));
+        memset(memo->buckets, 0xff, buckets * sizeof(uint32_t));
+        memo->bucket_mask = buckets - 1;
+    }
+
+    uint32_t hash = triangle_memo_hash(key);
+    for (uint32_t i = memo->buckets[hash & memo->bucket_mask]; i != TRIANGLE_MEMO_NIL; i = memo->entries[i].next) {
+        triangle_memo_entry* entry = &memo->entries[i];
+        if (entry->hash == hash && triangle_memo_same_input(&entry->input, tri)) {
+            entry->referenced = 1;
+            memo->hits++;
+            return entry;
+        }
+    }
+    memo->misses++;
+
+    // Take a free slot, or sweep the hand past recently used entries
+    uint32_t slot;
+    if (memo->count < memo->capacity) {
+        slot = (uint32_t)memo->count++;
+    } else {
+        while (memo->entries[memo->hand].referenced) {
+            memo->entries[memo->hand].referenced = 0;
+            memo->hand = (memo->hand + 1) % memo->capacity;
+        }
+        slot = (uint32_t)memo->hand;
+        memo->hand = (memo->hand + 1) % memo->capacity;
+        triangle_memo_unlink(memo, slot);
+    }
+
+    triangle_memo_entry* entry = &memo->entries[slot];
+    triangle_classify(tri, entry);
+    entry->input = *tri;
+    entry->hash = hash;
+    entry->referenced = 0;
+    entry->next = memo->buckets[hash & memo->bucket_mask];
+    memo->buckets[hash & memo->bucket_mask] = slot;
+    return entry;
+}
+
+// ==================== agents ====================
+// Fetches an agent's input; a missing or mistyped element fails that agent
+// run only, so pipelines can count it and go on with the next element
+static sc_result triangle_agent_input(sc_memory_context* ctx, sc_addr addr, sc_type_id type, void* out) {
+    sc_get_status status = sc_memory_try_get_by_handle(ctx, addr, type, (void**)out);
+    if (status != SC_GET_OK) {
+        SC_LOG_WARN(SC_LOG_FMT_TEXT, status == SC_GET_EMPTY ? "Agent input is missing" : "Agent input has the wrong type");
+        return SC_RESULT_ERROR;
+    }
+    return SC_RESULT_OK;
+}
+
+sc_result calculate_angles_agent_execute_by_handle(sc_memory_context* ctx, sc_addr tri_addr) {
+    triangle* tri;
+    if (triangle_agent_input(ctx, tri_addr, sc_type_triangle, &tri) != SC_RESULT_OK) {
+        return SC_RESULT_ERROR;
+    }
+    // rules_set not used in this agent
+
+    triangle_memo_entry scratch;
+    const triangle_memo_entry* memo = triangle_memo_lookup(tri, &scratch);
+
+    if (memo->calculated == SC_RESULT_OK) {
+        for (int i = 0; i < 3; i++) {
+            if (!tri->angles[i].is_known) {
+                tri->angles[i] = memo->completed.angles[i];
+                sc_memory_touch(ctx, tri_addr);
+                SC_LOG_DEBUG(SC_LOG_FMT_CALCULATED_ANGLE, tri->angles[i].value);
+                return SC_RESULT_OK;
+            }
+        }
+    }
+
+    SC_LOG_WARN(SC_LOG_FMT_CALCULATION_ERROR, triangle_status_names[memo->status]);
+    return SC_RESULT_ERROR;
+}
+
+sc_result calculate_angles_agent_execute(sc_memory_context* ctx) {
+    return calculate_angles_agent_execute_by_handle(ctx, sc_memory_resolve(ctx, "input_triangle"));
+}
+
+sc_result check_right_angle_agent_execute_by_handle(sc_memory_context* ctx, sc_addr tri_addr, sc_addr result_addr) {
+    triangle* tri;
+    if (triangle_agent_input(ctx, tri_addr, sc_type_triangle, &tri) != SC_RESULT_OK) {
+        return SC_RESULT_ERROR;
+    }
+    // rules_set not used in this agent
+
+    triangle_memo_entry scratch;
+    int is_right = triangle_memo_lookup(tri, &scratch)->is_right;
+    sc_memory_store_by_handle(ctx, result_addr, &is_right, sc_type_int);
+    if (is_right) {
+        SC_LOG_DEBUG(SC_LOG_FMT_TEXT, "Right angle detected (90°)");
+    }
+    return SC_RESULT_OK;
+}
+
+sc_result check_right_angle_agent_execute(sc_memory_context* ctx) {
+    return check_right_angle_agent_execute_by_handle(ctx, sc_memory_resolve(ctx, "input_triangle"),
+                                                     sc_memory_resolve(ctx, "is_right_triangle"));
+}
+
+// Event-driven wiring: calculate_angles reacts to input_triangle, check_right_angle
+// to any triangle (including the in-place completion) and the report to its result
+sc_result check_right_angle_agent_activate(sc_memory_context* ctx, sc_addr tri_addr) {
+    return check_right_angle_agent_execute_by_handle(ctx, tri_addr, sc_memory_resolve(ctx, "is_right_triangle"));
+}
+
+sc_result report_right_angle_agent_activate(sc_memory_context* ctx, sc_addr result_addr) {
+    int* is_right;
+    if (triangle_agent_input(ctx, result_addr, sc_type_int, &is_right) != SC_RESULT_OK) {
+        return SC_RESULT_ERROR;
+    }
+    sc_log_event(*is_right ? "Triangle is right-angled" : "Triangle is not right-angled");
+    return SC_RESULT_OK;
+}
+
+void triangle_agents_subscribe(sc_memory_context* ctx) {
+    sc_event_subscribe_addr(ctx, "input_triangle", calculate_angles_agent_execute_by_handle);
+    sc_event_subscribe_type(ctx, sc_type_triangle, check_right_angle_agent_activate);
+    sc_event_subscribe_addr(ctx, "is_right_triangle", report_right_angle_agent_activate);
+}
+
+// Completes all triangles of a batch element in one pass. Fails if any lane's
+// status is not TRIANGLE_OK; batch->status tells which lanes failed and why.
+sc_result calculate_angles_batch_agent_execute_by_handle(sc_memory_context* ctx, sc_addr batch_addr) {
+    triangle_batch* batch;
+    if (triangle_agent_input(ctx, batch_addr, sc_type_triangle_batch, &batch) != SC_RESULT_OK) {
+        return SC_RESULT_ERROR;
+    }
+
+    size_t completed = triangle_batch_complete_angles(batch, 0, triangle_batch_words(batch));
+
+    SC_LOG_INFO(SC_LOG_FMT_BATCH_CALCULATED, completed, batch->count);
+    return completed == batch->count ? SC_RESULT_OK : SC_RESULT_ERROR;
+}
+
+sc_result calculate_angles_batch_agent_execute(sc_memory_context* ctx) {
+    return calculate_angles_batch_agent_execute_by_handle(ctx, sc_memory_resolve(ctx, "input_triangle_batch"));
+}
+
+// Fills the batch is_right bitmask; fails only without a batch
+sc_result check_right_angle_batch_agent_execute_by_handle(sc_memory_context* ctx, sc_addr batch_addr) {
+    triangle_batch* batch;
+    if (triangle_agent_input(ctx, batch_addr, sc_type_triangle_batch, &batch) != SC_RESULT_OK) {
+        return SC_RESULT_ERROR;
+    }
+
+    size_t right = triangle_batch_detect_right_angles(batch, 0, triangle_batch_words(batch));
+
+    SC_LOG_INFO(SC_LOG_FMT_BATCH_RIGHT, right, batch->count);
+    return SC_RESULT_OK;
+}
+
+sc_result check_right_angle_batch_agent_execute(sc_memory_context* ctx) {
+    return check_right_angle_batch_agent_execute_by_handle(ctx, sc_memory_resolve(ctx, "input_triangle_batch"));
+}
+
+// Words per thread pool chunk: 4096 triangles, ~100 KB of angle values
+#define TRIANGLE_BATCH_CHUNK_WORDS 64
+
+typedef struct {
+    triangle_batch* batch;
+    size_t* completed; // per chunk, summed in chunk order afterwards
+    size_t* right;
+} triangle_batch_job;
+
+static void triangle_batch_process_range(void* arg, size_t word_begin, size_t word_end) {
+    triangle_batch_job* job = arg;
+    size_t chunk = word_begin / TRIANGLE_BATCH_CHUNK_WORDS;
+    job->completed[chunk] = triangle_batch_complete_angles(job->batch, word_begin, word_end);
+    job->right[chunk] = triangle_batch_detect_right_angles(job->batch, word_begin, word_end);
+}
+
+// Batch counterpart of triangle_processing_agent_execute: completes the angles
+// and detects right angles partition by partition on the pool (or inline when
+// pool is NULL). Fails if any lane's status is not TRIANGLE_OK; batch->status
+// tells which lanes failed and why.
+sc_result triangle_processing_batch_agent_execute_by_handle(sc_memory_context* ctx, sc_addr batch_addr,
+                                                            sc_thread_pool* pool) {
+    sc_stats_poll();
+    uint64_t start = sc_stats_begin();
+    sc_log_event("Starting triangle batch processing");
+    triangle_batch* batch;
+    if (triangle_agent_input(ctx, batch_addr, sc_type_triangle_batch, &batch) != SC_RESULT_OK) {
+        sc_stats_end(triangle_batch_stats_id, start, SC_RESULT_ERROR);
+        return SC_RESULT_ERROR;
+    }
+
+    size_t words = triangle_batch_words(batch);
+    size_t chunks = (words + TRIANGLE_BATCH_CHUNK_WORDS - 1) / TRIANGLE_BATCH_CHUNK_WORDS;
+    triangle_batch_job job = { batch, calloc(chunks, sizeof(size_t)), calloc(chunks, sizeof(size_t)) };
+    sc_thread_pool_parallel_for(pool, words, TRIANGLE_BATCH_CHUNK_WORDS, triangle_batch_process_range, &job);
+
+    size_t completed = 0;
+    size_t right = 0;
+    for (size_t c = 0; c < chunks; c++) {
+        completed += job.completed[c];
+        right += job.right[c];
+    }
+    free(job.completed);
+    free(job.right);
+
+    SC_LOG_INFO(SC_LOG_FMT_BATCH_PROCESSED, batch->count, completed, right);
+    sc_result result = completed == batch->count ? SC_RESULT_OK : SC_RESULT_ERROR;
+    sc_stats_end(triangle_batch_stats_id, start, result);
+    return result;
+}
+
+sc_result triangle_processing_batch_agent_execute(sc_memory_context* ctx, sc_thread_pool* pool) {
+    return triangle_processing_batch_agent_execute_by_handle(ctx, sc_memory_resolve(ctx, "input_triangle_batch"), pool);
+}
+
+// Processes the same random batch inline and on a 4-worker pool with small
+// chunks (so stealing happens) and checks both give identical bytes.
+int triangle_batch_parallel_selftest(void) {
+    const size_t count = 1000 * TRIANGLE_BATCH_LANES + 17;
+    triangle_batch serial, parallel;
+    triangle_batch_init(&serial, count);
+    triangle_batch_init(&parallel, count);
+
+    uint64_t state = 0x2545f4914f6cdd1dull;
+    for (size_t j = 0; j < count; j++) {
+        triangle tri;
+        for (int i = 0; i < 3; i++) {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            tri.angles[i].value = (double)(state % 180);
+            tri.angles[i].is_known = (state >> 32) % 4 != 0;
+        }
+        triangle_batch_push(&serial, &tri);
+        triangle_batch_push(&parallel, &tri);
+    }
+
+    size_t words = triangle_batch_words(&serial);
+    size_t chunks = (words + TRIANGLE_BATCH_CHUNK_WORDS - 1) / TRIANGLE_BATCH_CHUNK_WORDS;
+    triangle_batch_job serial_job = { &serial, calloc(chunks, sizeof(size_t)), calloc(chunks, sizeof(size_t)) };
+    triangle_batch_job parallel_job = { &parallel, calloc(chunks, sizeof(size_t)), calloc(chunks, sizeof(size_t)) };
+
+    sc_thread_pool pool;
+    sc_thread_pool_init(&pool, 4);
+    sc_thread_pool_parallel_for(NULL, words, TRIANGLE_BATCH_CHUNK_WORDS, triangle_batch_process_range, &serial_job);
+    sc_thread_pool_parallel_for(&pool, words, TRIANGLE_BATCH_CHUNK_WORDS, triangle_batch_process_range, &parallel_job);
+    sc_thread_pool_destroy(&pool);
+
+    size_t serial_completed = 0, parallel_completed = 0;
+    for (size_t c = 0; c < chunks; c++) {
+        serial_completed += serial_job.completed[c];
+        parallel_completed += parallel_job.completed[c];
+    }
+    int ok = serial_completed == parallel_completed &&
+             memcmp(serial.value[0], parallel.value[0], triangle_batch_bytes(serial.capacity)) == 0;
+    printf("%-8s %s (%zu completed on 4 workers)\n", "pool", ok ? "ok" : "MISMATCH", parallel_completed);
+
+    free(serial_job.completed);
+    free(serial_job.right);
+    free(parallel_job.completed);
+    free(parallel_job.right);
+    triangle_batch_destroy(&parallel);
+    triangle_batch_destroy(&serial);
+    return ok;
+}
+
+// The pipeline behind triangle_processing_agent_execute, declared as data: the
+// DAG (calculate -> check -> report) is derived once by triangle_domain_init
+static sc_agent_registry triangle_pipeline;
+
+static sc_result calculate_angles_step(sc_memory_context* ctx, const sc_addr* reads, const sc_addr* writes) {
+    (void)writes; // completes reads[0] in place
+    return calculate_angles_agent_execute_by_handle(ctx, reads[0]);
+}
+
+static sc_result check_right_angle_step(sc_memory_context* ctx, const sc_addr* reads, const sc_addr* writes) {
+    return check_right_angle_agent_execute_by_handle(ctx, reads[0], writes[0]);
+}
+
+static sc_result report_right_angle_step(sc_memory_context* ctx, const sc_addr* reads, const sc_addr* writes) {
+    (void)writes;
+    return report_right_angle_agent_activate(ctx, reads[0]);
+}
+
+static void triangle_pipeline_build(void) {
+    static const sc_agent_desc agents[] = {
+        { "calculate_angles", calculate_angles_step, { "input_triangle" }, { "input_triangle" } },
+        { "check_right_angle", check_right_angle_step, { "input_triangle" }, { "is_right_triangle" } },
+        { "report_right_angle", report_right_angle_step, { "is_right_triangle" }, { NULL } },
+    };
+    sc_agent_registry_init(&triangle_pipeline);
+    for (size_t i = 0; i < sizeof(agents) / sizeof(agents[0]); i++) {
+        sc_agent_registry_add(&triangle_pipeline, &agents[i]);
+    }
+    sc_agent_registry_build(&triangle_pipeline);
+    // The calculate and check steps both go through the process-wide memo
+    triangle_pipeline.shares_state = triangle_memo_enabled;
+}
+
+// Resolves the pipeline addresses in ctx once, for repeated _bound runs
+void triangle_pipeline_bind(sc_memory_context* ctx, sc_agent_binding* bindings) {
+    sc_agent_registry_bind(&triangle_pipeline, ctx, bindings);
+}
+
+sc_result triangle_processing_agent_execute_bound(sc_memory_context* ctx, sc_agent_binding* bindings,
+                                                  sc_thread_pool* pool) {
+    sc_log_event("Starting triangle processing");
+    return sc_agent_registry_run(&triangle_pipeline, ctx, bindings, pool);
+}
+
+// Agents whose inputs did not change since the previous call on ctx are skipped
+sc_result triangle_processing_agent_execute(sc_memory_context* ctx) {
+    return triangle_processing_agent_execute_bound(ctx, sc_agent_registry_bindings(&triangle_pipeline, ctx), NULL);
+}
+
+// Classifies first and then second through a fresh memo; both must come out
+// as they do uncached. Returns the number of differences.
+static int triangle_memo_selftest_order(const triangle* first, const triangle* second) {
+    const triangle* order[2] = { first, second };
+    int errors = 0;
+    triangle_memo_configure(TRIANGLE_MEMO_DEFAULT_CAPACITY);
+    for (int k = 0; k < 2; k++) {
+        triangle_memo_entry scratch, expected;
+        const triangle_memo_entry* cached = triangle_memo_lookup(order[k], &scratch);
+        triangle_classify(order[k], &expected);
+        errors += cached->status != expected.status || cached->is_right != expected.is_right ||
+                  cached->completed_is_right != expected.completed_is_right;
+        for (int i = 0; i < 3; i++) {
+            errors += expected.completed.angles[i].is_known &&
+                      memcmp(&cached->completed.angles[i].value, &expected.completed.angles[i].value,
+                             sizeof(double)) != 0;
+        }
+    }
+    return errors;
+}
+
+// A missing or mistyped input fails the run without ending the process, and
+// the next valid triangle goes through as usual
+int triangle_agents_selftest(void) {
+    sc_log_set_level(SC_LOG_LEVEL_ERROR); // the failures below warn
+    sc_memory_context ctx;
+    sc_memory_init(&ctx, 10);
+    int errors = 0;
+    size_t failures = 0;
+    void* value;
+    errors += sc_memory_try_get(&ctx, "input_triangle", "triangle", &value) != SC_GET_EMPTY || value != NULL;
+    failures += triangle_processing_agent_execute(&ctx) == SC_RESULT_ERROR;
+
+    int wrong = 7;
+    sc_memory_store(&ctx, "input_triangle", &wrong, "int");
+    errors += sc_memory_try_get(&ctx, "input_triangle", "triangle", &value) != SC_GET_TYPE_MISMATCH || value != NULL;
+    failures += triangle_processing_agent_execute(&ctx) == SC_RESULT_ERROR;
+    sc_memory_store(&ctx, "input_triangle_batch", &wrong, "int");
+    failures += triangle_processing_batch_agent_execute(&ctx, NULL) == SC_RESULT_ERROR;
+
+    triangle tri = { { {90.0, 1}, {45.0, 1}, {0.0, 0} } };
+    sc_memory_store(&ctx, "input_triangle", &tri, "triangle");
+    errors += triangle_processing_agent_execute(&ctx) != SC_RESULT_OK;
+    errors += sc_memory_try_get(&ctx, "is_right_triangle", "int", &value) != SC_GET_OK || !*(int*)value;
+    errors += failures != 3;
+
+    // The same triangle with other padding bytes is not a change
+    const triangle* stored = sc_memory_get(&ctx, "input_triangle", "triangle");
+    triangle same;
+    memset(&same, 0xA5, sizeof(same));
+    for (int j = 0; j < 3; j++) {
+        same.angles[j].value = stored->angles[j].value;
+        same.angles[j].is_known = stored->angles[j].is_known;
+    }
+    sc_addr input = sc_memory_resolve(&ctx, "input_triangle");
+    uint64_t version = sc_memory_version(&ctx, input);
+    sc_memory_store(&ctx, "input_triangle", &same, "triangle");
+    errors += sc_memory_version(&ctx, input) != version;
+
+    // The check agent looks at the stored angles only, cached or not: an
+    // uncompleted 45/45/? is not right-angled although its completion is
+    triangle isosceles = { { {45.0, 1}, {45.0, 1}, {0.0, 0} } };
+    sc_memory_store(&ctx, "input_triangle", &isosceles, "triangle");
+    for (int k = 0; k < 2; k++) {
+        errors += check_right_angle_agent_execute(&ctx) != SC_RESULT_OK;
+        errors += sc_memory_try_get(&ctx, "is_right_triangle", "int", &value) != SC_GET_OK || *(int*)value;
+    }
+
+    // Inputs sharing a memo quantum across the right-angle epsilon and the
+    // 180 degree sum, in both orders
+    triangle near_right = { { {89.9990004, 1}, {45.0, 1}, {45.0009996, 1} } };
+    triangle off_right = { { {89.999, 1}, {45.0, 1}, {45.001, 1} } };
+    triangle near_full = { { {89.9999996, 1}, {90.0, 1}, {0.0, 0} } };
+    triangle full = { { {90.0, 1}, {90.0, 1}, {0.0, 0} } };
+    triangle_memo_entry a, b;
+    triangle_classify(&near_right, &a);
+    triangle_classify(&off_right, &b);
+    errors += a.is_right == b.is_right; // otherwise the cases below prove nothing
+    triangle_classify(&near_full, &a);
+    triangle_classify(&full, &b);
+    errors += a.status == b.status;
+    errors += triangle_memo_selftest_order(&near_right, &off_right);
+    errors += triangle_memo_selftest_order(&off_right, &near_right);
+    errors += triangle_memo_selftest_order(&near_full, &full);
+    errors += triangle_memo_selftest_order(&full, &near_full);
+    triangle_memo_configure(TRIANGLE_MEMO_DEFAULT_CAPACITY);
+    sc_memory_destroy(&ctx);
+    sc_log_set_level(SC_LOG_LEVEL_INFO);
+
+    // Batch statuses and completions match the single-triangle agent
+    static const double samples[] = { 90.0, 45.0, 60.0, 100.0, 180.0, 0.0, -0.0, -30.0, NAN, INFINITY };
+    enum { lanes = 1000 };
+    triangle* inputs = malloc(lanes * sizeof(triangle));
+    triangle_batch batch;
+    triangle_batch_init(&batch, lanes);
+    uint64_t state = 0x853c49e6748fea9bull;
+    for (size_t j = 0; j < lanes; j++) {
+        for (int i = 0; i < 3; i++) {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            inputs[j].angles[i].value = samples[state % 10];
+            inputs[j].angles[i].is_known = (state >> 32) % 4 != 0;
+        }
+        triangle_batch_push(&batch, &inputs[j]);
+    }
+    size_t completed = triangle_batch_complete_angles(&batch, 0, triangle_batch_words(&batch));
+    size_t counts[TRIANGLE_STATUS_COUNT] = { 0 };
+    triangle_batch_count_status(&batch, counts);
+    errors += counts[TRIANGLE_OK] != completed;
+    size_t expected_counts[TRIANGLE_STATUS_COUNT] = { 0 };
+    for (size_t j = 0; j < lanes; j++) {
+        triangle_memo_entry expected;
+        triangle_classify(&inputs[j], &expected);
+        triangle actual;
+        triangle_batch_get(&batch, j, &actual);
+        errors += batch.status[j] != expected.status;
+        expected_counts[expected.status]++;
+        for (int i = 0; i < 3; i++) {
+            errors += actual.angles[i].is_known != expected.completed.angles[i].is_known;
+            errors += actual.angles[i].is_known &&
+                      memcmp(&actual.angles[i].value, &expected.completed.angles[i].value, sizeof(double)) != 0;
+        }
+    }
+    errors += memcmp(counts, expected_counts, sizeof(counts)) != 0;
+    // A byte out of range, as a mapped file may hold, is not counted
+    expected_counts[batch.status[lanes / 2]]--;
+    batch.status[lanes / 2] = 0xC3;
+    memset(counts, 0, sizeof(counts));
+    triangle_batch_count_status(&batch, counts);
+    errors += memcmp(counts, expected_counts, sizeof(counts)) != 0;
+    triangle_batch_destroy(&batch);
+    free(inputs);
+
+    printf("%-8s %s (%zu bad inputs failed their run, %zu of %d batch lanes completed like single triangles)\n",
+           "agents", errors == 0 ? "ok" : "MISMATCH", failures, completed, lanes);
+    return errors == 0;
+}
+
+// ==================== triangle ingest ====================
+// Streaming readers that turn a file descriptor into triangle batches without
+// holding more than one read buffer and one batch. Each full batch (and the
+// last partial one) is handed to a callback, which may keep or process it but
+// must not hold on to it: the batch is cleared and refilled afterwards.
+//
+// CSV: one triangle per line, "A,B,C", where an angle is a number or "?" for
+// an unknown one (the print_sc_memory notation). Blanks around fields,
+// CRLF line ends, '#' comment lines and a header line are accepted; fields
+// after the third (like the result writer's right column) are ignored.
+// Binary: fixed-width 25-byte records of three host-order doubles followed by
+// a known-angle mask byte (bit i set when angle i is known; bit 3, the result
+// writer's right-angle flag, is ignored).
+#define TRIANGLE_INGEST_BUFFER (64 * 1024)
+#define TRIANGLE_INGEST_RECORD_SIZE 25
+
+// Returns nonzero to keep reading
+typedef int (*triangle_ingest_fn)(void* arg, triangle_batch* batch);
+
+typedef struct {
+    size_t triangles;      // pushed into batches
+    size_t batches;        // callback calls
+    size_t rejected;       // malformed lines or records, skipped
+    size_t first_rejected; // 1-based line or record number, 0 if none
+} triangle_ingest_stats;
+
+typedef struct {
+    triangle_batch batch;
+    triangle_ingest_fn fn;
+    void* arg;
+    triangle_ingest_stats* stats;
+    int stopped;
+} triangle_ingest_sink;
+
+static void triangle_ingest_sink_init(triangle_ingest_sink* sink, size_t batch_size, triangle_ingest_fn fn,
+                                      void* arg, triangle_ingest_stats* stats) {
+    triangle_batch_init(&sink->batch, batch_size);
+    sink->fn = fn;
+    sink->arg = arg;
+    sink->stats = stats;
+    sink->stopped = 0;
+    memset(stats, 0, sizeof(*stats));
+}
+
+static void triangle_ingest_sink_flush(triangle_ingest_sink* sink) {
+    if (sink->batch.count > 0 && !sink->stopped) {
+        sink->stats->batches++;
+        sink->stopped = !sink->fn(sink->arg, &sink->batch);
+    }
+    triangle_batch_clear(&sink->batch);
+}
+
+static void triangle_ingest_sink_push(triangle_ingest_sink* sink, const triangle* tri) {
+    if (!triangle_batch_push(&sink->batch, tri)) {
+        triangle_ingest_sink_flush(sink);
+        triangle_batch_push(&sink->batch, tri);
+    }
+    sink->stats->triangles++;
+}
+
+static void triangle_ingest_reject(triangle_ingest_stats* stats, size_t number) {
+    if (stats->rejected++ == 0) {
+        stats->first_rejected = number;
+    }
+}
+
+// read() that retries on EINTR and fills as much of buf as it can; returns
+// the byte count (short only at end of file) or -1
+static ssize_t triangle_ingest_read(int fd, char* buf, size_t size) {
+    size_t filled = 0;
+    while (filled < size) {
+        ssize_t n = read(fd, buf + filled, size - filled);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+        filled += (size_t)n;
+    }
+    return (ssize_t)filled;
+}
+
+static const double triangle_pow10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+// Parses a decimal number at [p, end) and returns the first unparsed byte,
+// or NULL if there is no number. Mantissas up to 2^53 with decimal exponents
+// within +-22 are exact in one multiplication or division (Clinger's fast
+// path); everything else goes through strtod on a stack copy.
+static const char* triangle_parse_double(const char* p, const char* end, double* out) {
+    const char* start = p;
+    int negative = 0;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p++ == '-';
+    }
+
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    int seen_digit = 0;
+    int truncated = 0;
+    for (; p < end && *p >= '0' && *p <= '9'; p++) {
+        seen_digit = 1;
+        if (digits < 19) {
+            mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+            digits += mantissa != 0;
+        } else {
+            exponent++;
+            truncated |= *p != '0';
+        }
+    }
+    if (p < end && *p == '.') {
+        for (p++; p < end && *p >= '0' && *p <= '9'; p++) {
+            seen_digit = 1;
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+                digits += mantissa != 0;
+                exponent--;
+            } else {
+                truncated |= *p != '0';
+            }
+        }
+    }
+    if (!seen_digit) {
+        return NULL;
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char* q = p + 1;
+        int exp_negative = 0;
+        if (q < end && (*q == '-' || *q == '+')) {
+            exp_negative = *q++ == '-';
+        }
+        if (q < end && *q >= '0' && *q <= '9') {
+            int value = 0;
+            for (; q < end && *q >= '0' && *q <= '9'; q++) {
+                value = value < 100000 ? value * 10 + (*q - '0') : value;
+            }
+            exponent += exp_negative ? -value : value;
+            p = q;
+        }
+    }
+
+    if (!truncated && mantissa <= (1ull << 53) && exponent >= -22 && exponent <= 22) {
+        double value = (double)mantissa;
+        value = exponent < 0 ? value / triangle_pow10[-exponent] : value * triangle_pow10[exponent];
+        *out = negative ? -value : value;
+        return p;
+    }
+
+    char copy[128];
+    if ((size_t)(p - start) >= sizeof(copy)) {
+        return NULL;
+    }
+    memcpy(copy, start, (size_t)(p - start));
+    copy[p - start] = '\0';
+    char* parsed;
+    *out = strtod(copy, &parsed);
+    return parsed == copy + (p - start) ? p : NULL;
+}
+
+static const char* triangle_ingest_skip_blanks(const char* p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t')) {
+        p++;
+    }
+    return p;
+}
+
+// Parses one CSV line (without its '\n'); returns 1 on success
+static int triangle_ingest_parse_line(const char* p, const char* end, triangle* tri) {
+    if (end > p && end[-1] == '\r') {
+        end--;
+    }
+    for (int i = 0; i < 3; i++) {
+        p = triangle_ingest_skip_blanks(p, end);
+        if (p < end && *p == '?') {
+            tri->angles[i].value = 0.0;
+            tri->angles[i].is_known = 0;
+            p++;
+        } else {
+            p = triangle_parse_double(p, end, &tri->angles[i].value);
+            if (p == NULL) {
+                return 0;
+            }
+            tri->angles[i].is_known = 1;
+        }
+        p = triangle_ingest_skip_blanks(p, end);
+        if (i < 2) {
+            if (p == end || *p != ',') {
+                return 0;
+            }
+            p++;
+        }
+    }
+    return p == end || *p == ',';
+}
+
+static int triangle_ingest_is_blank(const char* p, const char* end) {
+    p = triangle_ingest_skip_blanks(p, end);
+    return p == end || *p == '\r' || *p == '#';
+}
+
+// Streams CSV triangles from fd into batches of batch_size. Malformed lines
+// are counted and skipped; a first line that does not parse is taken as a
+// header. Fails on a read error or a line longer than the read buffer.
+sc_result triangle_ingest_csv(int fd, size_t batch_size, triangle_ingest_fn fn, void* arg,
+                              triangle_ingest_stats* stats) {
+    triangle_ingest_sink sink;
+    triangle_ingest_sink_init(&sink, batch_size, fn, arg, stats);
+    char* buffer = malloc(TRIANGLE_INGEST_BUFFER);
+    sc_result result = SC_RESULT_OK;
+    size_t filled = 0;
+    size_t line_number = 0;
+    int eof = 0;
+
+    while (!eof && !sink.stopped) {
+        ssize_t n = triangle_ingest_read(fd, buffer + filled, TRIANGLE_INGEST_BUFFER - filled);
+        if (n < 0) {
+            result = SC_RESULT_ERROR;
+            break;
+        }
+        eof = filled + (size_t)n < TRIANGLE_INGEST_BUFFER;
+        const char* line = buffer;
+        const char* end = buffer + filled + n;
+        while (line < end && !sink.stopped) {
+            const char* newline = memchr(line, '\n', (size_t)(end - line));
+            if (newline == NULL && !eof) {
+                break; // the rest of the line is in the next chunk
+            }
+            const char* line_end = newline != NULL ? newline : end;
+            line_number++;
+            triangle tri;
+            if (triangle_ingest_parse_line(line, line_end, &tri)) {
+                triangle_ingest_sink_push(&sink, &tri);
+            } else if (!triangle_ingest_is_blank(line, line_end) && !(line_number == 1 && stats->triangles == 0)) {
+                triangle_ingest_reject(stats, line_number);
+            }
+            line = newline != NULL ? newline + 1 : end;
+        }
+        filled = (size_t)(end - line);
+        if (filled == TRIANGLE_INGEST_BUFFER) {
+            fprintf(stderr, "CSV line %zu is longer than %d bytes\n", line_number + 1, TRIANGLE_INGEST_BUFFER);
+            result = SC_RESULT_ERROR;
+            break;
+        }
+        memmove(buffer, line, filled);
+    }
+
+    triangle_ingest_sink_flush(&sink);
+    triangle_batch_destroy(&sink.batch);
+    free(buffer);
+    return result;
+}
+
+// Streams fixed-width binary records from fd into batches of batch_size.
+// Records with unknown mask bits and a truncated last record are rejected.
+sc_result triangle_ingest_binary(int fd, size_t batch_size, triangle_ingest_fn fn, void* arg,
+                                 triangle_ingest_stats* stats) {
+    triangle_ingest_sink sink;
+    triangle_ingest_sink_init(&sink, batch_size, fn, arg, stats);
+    // Whole records per read, so none straddles two chunks
+    const size_t chunk = TRIANGLE_INGEST_BUFFER / TRIANGLE_INGEST_RECORD_SIZE * TRIANGLE_INGEST_RECORD_SIZE;
+    char* buffer = malloc(chunk);
+    sc_result result = SC_RESULT_OK;
+    size_t record_number = 0;
+
+    while (!sink.stopped) {
+        ssize_t n = triangle_ingest_read(fd, buffer, chunk);
+        if (n < 0) {
+            result = SC_RESULT_ERROR;
+            break;
+        }
+        size_t records = (size_t)n / TRIANGLE_INGEST_RECORD_SIZE;
+        for (size_t r = 0; r < records && !sink.stopped; r++) {
+            const char* record = buffer + r * TRIANGLE_INGEST_RECORD_SIZE;
+            unsigned char mask = (unsigned char)record[24];
+            record_number++;
+            if (mask > 15) {
+                triangle_ingest_reject(stats, record_number);
+                continue;
+            }
+            triangle tri;
+            for (int i = 0; i < 3; i++) {
+                memcpy(&tri.angles[i].value, record + i * sizeof(double), sizeof(double));
+                tri.angles[i].is_known = (mask >> i) & 1;
+            }
+            triangle_ingest_sink_push(&sink, &tri);
+        }
+        if ((size_t)n < chunk) {
+            if ((size_t)n % TRIANGLE_INGEST_RECORD_SIZE != 0) {
+                triangle_ingest_reject(stats, record_number + 1);
+            }
+            break;
+        }
+    }
+
+    triangle_ingest_sink_flush(&sink);
+    triangle_batch_destroy(&sink.batch);
+    free(buffer);
+    return result;
+}
+
+// Ingest callback feeding each batch through the batch processing agent
+struct sc_out;
+
+typedef struct {
+    sc_memory_context* ctx;
+    sc_thread_pool* pool; // NULL processes inline
+    size_t right;
+    size_t failed_batches; // batches with a triangle that could not be completed
+    struct sc_out* out;    // receives the processed triangles when not NULL
+    int out_format;        // a triangle_out_format
+    size_t by_status[TRIANGLE_STATUS_COUNT]; // triangles per triangle_status
+} triangle_ingest_pipeline;
+
+void triangle_out_write_batch(struct sc_out* out, int format, const triangle_batch* batch);
+
+// Prints ", <count> <status>" for every status but OK that occurred
+static void triangle_ingest_pipeline_print_failures(FILE* out, const triangle_ingest_pipeline* pipeline) {
+    for (int status = TRIANGLE_OK + 1; status < TRIANGLE_STATUS_COUNT; status++) {
+        if (pipeline->by_status[status] > 0) {
+            fprintf(out, ", %zu %s", pipeline->by_status[status], triangle_status_names[status]);
+        }
+    }
+}
+
+int triangle_ingest_pipeline_push(void* arg, triangle_batch* batch) {
+    triangle_ingest_pipeline* pipeline = arg;
+    sc_memory_store(pipeline->ctx, "input_triangle_batch", batch, "triangle_batch");
+    if (triangle_processing_batch_agent_execute(pipeline->ctx, pipeline->pool) == SC_RESULT_OK) {
+        pipeline->by_status[TRIANGLE_OK] += batch->count; // every lane completed
+    } else {
+        pipeline->failed_batches++;
+        triangle_batch_count_status(batch, pipeline->by_status);
+    }
+    for (size_t w = 0; w < triangle_batch_words(batch); w++) {
+        pipeline->right += (size_t)__builtin_popcountll(batch->is_right[w]);
+    }
+    if (pipeline->out != NULL) {
+        triangle_out_write_batch(pipeline->out, pipeline->out_format, batch);
+    }
+    return 1;
+}
+
+typedef struct {
+    triangle* triangles;
+    size_t count;
+    size_t capacity;
+} triangle_ingest_collector;
+
+static int triangle_ingest_collect(void* arg, triangle_batch* batch) {
+    triangle_ingest_collector* collector = arg;
+    for (size_t j = 0; j < batch->count; j++) {
+        if (collector->count < collector->capacity) {
+            triangle_batch_get(batch, j, &collector->triangles[collector->count++]);
+        }
+    }
+    return 1;
+}
+
+#define TRIANGLE_INGEST_SELFTEST_LINES 6000
+
+static int triangle_ingest_mismatches(const triangle* got, const triangle* expected, size_t count) {
+    int mismatches = 0;
+    for (size_t j = 0; j < count; j++) {
+        for (int i = 0; i < 3; i++) {
+            mismatches += got[j].angles[i].is_known != expected[j].angles[i].is_known ||
+                          got[j].angles[i].value != expected[j].angles[i].value;
+        }
+    }
+    return mismatches;
+}
+
+// Round-trips generated triangles through a CSV file larger than the read
+// buffer (so lines straddle chunks) and through the binary format
+int triangle_ingest_selftest(void) {
+    FILE* csv = tmpfile();
+    FILE* bin = tmpfile();
+    triangle* expected = malloc(TRIANGLE_INGEST_SELFTEST_LINES * sizeof(triangle));
+    fputs("A,B,C\r\n# comment\n\n", csv);
+    uint64_t state = 0x9e3779b97f4a7c15ull;
+    for (size_t j = 0; j < TRIANGLE_INGEST_SELFTEST_LINES; j++) {
+        triangle* tri = &expected[j];
+        for (int i = 0; i < 3; i++) {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            // Mixes fast-path values with 17 significant digits that need strtod
+            tri->angles[i].value = j % 3 == 0 ? (double)(state % 18000) / 100.0 : (double)(state % 1000000) / 7.0;
+            tri->angles[i].is_known = (state >> 40) % 4 != 0;
+            if (tri->angles[i].is_known) {
+                fprintf(csv, j % 5 == 0 ? " %.17g " : "%.17g", tri->angles[i].value);
+            } else {
+                tri->angles[i].value = 0.0;
+                fputs("?", csv);
+            }
+            fputs(i < 2 ? "," : (j % 2 == 0 ? "\r\n" : "\n"), csv);
+        }
+        char record[TRIANGLE_INGEST_RECORD_SIZE];
+        record[24] = 0;
+        for (int i = 0; i < 3; i++) {
+            memcpy(record + i * sizeof(double), &tri->angles[i].value, sizeof(double));
+            record[24] |= (char)(tri->angles[i].is_known << i);
+        }
+        fwrite(record, 1, sizeof(record), bin);
+        if (j == 100) {
+            char bad[TRIANGLE_INGEST_RECORD_SIZE] = { 0 };
+            bad[24] = 0x10;
+            fputs("1,2\n", csv);
+            fwrite(bad, 1, sizeof(bad), bin);
+        }
+    }
+    fputs("60,60,60", csv); // no final newline
+    fwrite("truncated", 1, 9, bin);
+    fflush(csv);
+    fflush(bin);
+
+    triangle_ingest_collector collector = { malloc((TRIANGLE_INGEST_SELFTEST_LINES + 1) * sizeof(triangle)), 0,
+                                            TRIANGLE_INGEST_SELFTEST_LINES + 1 };
+    triangle_ingest_stats csv_stats, bin_stats;
+    lseek(fileno(csv), 0, SEEK_SET);
+    int errors = triangle_ingest_csv(fileno(csv), 1000, triangle_ingest_collect, &collector, &csv_stats) != SC_RESULT_OK;
+    errors += csv_stats.triangles != TRIANGLE_INGEST_SELFTEST_LINES + 1 || csv_stats.rejected != 1 ||
+              csv_stats.first_rejected != 105 || collector.triangles[TRIANGLE_INGEST_SELFTEST_LINES].angles[2].value != 60.0;
+    errors += triangle_ingest_mismatches(collector.triangles, expected, TRIANGLE_INGEST_SELFTEST_LINES);
+
+    collector.count = 0;
+    lseek(fileno(bin), 0, SEEK_SET);
+    errors += triangle_ingest_binary(fileno(bin), 1000, triangle_ingest_collect, &collector, &bin_stats) != SC_RESULT_OK;
+    // The record with an unknown mask bit and the truncated tail are rejected
+    errors += bin_stats.triangles != TRIANGLE_INGEST_SELFTEST_LINES || bin_stats.rejected != 2;
+    errors += triangle_ingest_mismatches(collector.triangles, expected, TRIANGLE_INGEST_SELFTEST_LINES);
+
+    printf("%-8s %s (%zu CSV lines in %zu batches, %zu binary records)\n", "ingest", errors == 0 ? "ok" : "MISMATCH",
+           csv_stats.triangles, csv_stats.batches, bin_stats.triangles);
+    free(collector.triangles);
+    free(expected);
+    fclose(csv);
+    fclose(bin);
+    return errors == 0;
+}
+
+// ==================== triangle batch files ====================
+// Zero-copy batch format: a file is a sequence of frames, each a 64-byte
+// header followed by one batch block laid out exactly like triangle_batch
+// keeps it in memory (three value arrays, the is_known and is_right words,
+// then the status bytes), with capacity trimmed to count rounded up to whole lane words.
+// A mapped frame is a ready triangle_batch whose arrays point into the
+// mapping, so the kernels run on the file pages directly.
+//
+// A private mapping leaves the file untouched; kernel writes only copy the
+// pages they dirty. A write-back mapping stores the completed angles and
+// right-angle masks into the file itself.
+#define TRIANGLE_BATCH_FILE_MAGIC "SCTRIBAT"
+#define TRIANGLE_BATCH_FILE_VERSION 2 // 2 added the status bytes
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order; // SC_SNAPSHOT_BYTE_ORDER as written
+    uint64_t count;
+    uint64_t capacity;   // lanes, a multiple of TRIANGLE_BATCH_LANES
+    uint64_t frame_size; // header included
+    uint64_t reserved[3];
+} triangle_batch_frame_header;
+
+typedef struct {
+    unsigned char* base;
+    size_t size;
+    size_t offset; // of the next frame
+} triangle_batch_file;
+
+// write() of a whole iovec list, resuming after short writes
+static sc_result sc_writev_all(int fd, struct iovec* iov, int count) {
+    while (count > 0) {
+        ssize_t n = writev(fd, iov, count);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return SC_RESULT_ERROR;
+        }
+        while (count > 0 && (size_t)n >= iov->iov_len) {
+            n -= (ssize_t)iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char*)iov->iov_base + n;
+            iov->iov_len -= (size_t)n;
+        }
+    }
+    return SC_RESULT_OK;
+}
+
+// Appends batch to fd as one frame, gathering its arrays with a single writev
+sc_result triangle_batch_file_append(int fd, const triangle_batch* batch) {
+    size_t capacity = (batch->count + TRIANGLE_BATCH_LANES - 1) / TRIANGLE_BATCH_LANES * TRIANGLE_BATCH_LANES;
+    if (capacity == 0) {
+        capacity = TRIANGLE_BATCH_LANES;
+    }
+    size_t words = capacity / TRIANGLE_BATCH_LANES;
+    size_t block = triangle_batch_bytes(capacity);
+    static const unsigned char padding[64];
+
+    triangle_batch_frame_header header = { TRIANGLE_BATCH_FILE_MAGIC, TRIANGLE_BATCH_FILE_VERSION,
+                                           SC_SNAPSHOT_BYTE_ORDER, batch->count, capacity,
+                                           sizeof(header) + block, { 0, 0, 0 } };
+    struct iovec iov[10];
+    int n = 0;
+    iov[n++] = (struct iovec){ &header, sizeof(header) };
+    for (int i = 0; i < 3; i++) {
+        iov[n++] = (struct iovec){ batch->value[i], capacity * sizeof(double) };
+    }
+    for (int i = 0; i < 3; i++) {
+        iov[n++] = (struct iovec){ batch->is_known[i], words * sizeof(uint64_t) };
+    }
+    iov[n++] = (struct iovec){ batch->is_right, words * sizeof(uint64_t) };
+    iov[n++] = (struct iovec){ batch->status, capacity };
+    iov[n++] = (struct iovec){ (void*)padding,
+                               block - 3 * capacity * sizeof(double) - 4 * words * sizeof(uint64_t) - capacity };
+    return sc_writev_all(fd, iov, n);
+}
+
+// Ingest callback appending every batch as a frame; stops at the first failed write
+typedef struct {
+    int fd;
+    size_t frames;
+    sc_result result;
+} triangle_batch_file_writer;
+
+int triangle_batch_file_append_fn(void* arg, triangle_batch* batch) {
+    triangle_batch_file_writer* writer = arg;
+    writer->result = triangle_batch_file_append(writer->fd, batch);
+    writer->frames += writer->result == SC_RESULT_OK;
+    return writer->result == SC_RESULT_OK;
+}
+
+// Maps path for reading frames; writeback makes kernel results land in the file
+sc_result triangle_batch_file_map(triangle_batch_file* file, const char* path, int writeback) {
+    memset(file, 0, sizeof(*file));
+    int fd = open(path, writeback ? O_RDWR : O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        fprintf(stderr, "Cannot open triangle batch file: %s\n", path);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return SC_RESULT_ERROR;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        return SC_RESULT_OK; // no frames
+    }
+    void* base = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, writeback ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        fprintf(stderr, "Cannot map triangle batch file: %s\n", path);
+        return SC_RESULT_ERROR;
+    }
+    // Frames are consumed front to back; large pages cut TLB misses where the
+    // file system supports them. Both are hints, so failures are ignored.
+    madvise(base, (size_t)st.st_size, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+    madvise(base, (size_t)st.st_size, MADV_HUGEPAGE);
+#endif
+    file->base = base;
+    file->size = (size_t)st.st_size;
+    return SC_RESULT_OK;
+}
+
+// Points batch at the next frame. Returns 1 for a frame, 0 at the end of the
+// file and -1 for a corrupt frame. The batch belongs to the mapping: do not
+// triangle_batch_destroy it or use it after triangle_batch_file_unmap.
+int triangle_batch_file_next(triangle_batch_file* file, triangle_batch* batch) {
+    size_t remaining = file->size - file->offset;
+    if (remaining == 0) {
+        return 0;
+    }
+    triangle_batch_frame_header header;
+    if (remaining < sizeof(header)) {
+        return -1;
+    }
+    memcpy(&header, file->base + file->offset, sizeof(header));
+    if (memcmp(header.magic, TRIANGLE_BATCH_FILE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != TRIANGLE_BATCH_FILE_VERSION || header.byte_order != SC_SNAPSHOT_BYTE_ORDER ||
+        header.capacity == 0 || header.capacity % TRIANGLE_BATCH_LANES != 0 || header.count > header.capacity ||
+        header.capacity > remaining / (3 * sizeof(double)) ||
+        header.frame_size != sizeof(header) + triangle_batch_bytes(header.capacity) ||
+        header.frame_size > remaining) {
+        return -1;
+    }
+
+    batch->count = header.count;
+    triangle_batch_layout(batch, file->base + file->offset + sizeof(header), header.capacity);
+    file->offset += header.frame_size;
+    return 1;
+}
+
+void triangle_batch_file_unmap(triangle_batch_file* file) {
+    if (file->base != NULL) {
+        munmap(file->base, file->size);
+    }
+    memset(file, 0, sizeof(*file));
+}
+
+// Writes two frames, then checks a private mapping processes them exactly
+// like in-memory batches without touching the file, and a write-back
+// mapping persists the results
+int triangle_batch_file_selftest(void) {
+    char path[] = "/tmp/sc_batch_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        printf("%-8s %s\n", "mapfile", "SKIPPED (no temporary file)");
+        return 1;
+    }
+    triangle_batch batches[2];
+    uint64_t state = 0x853c49e6748fea9bull;
+    int errors = 0;
+    for (int b = 0; b < 2; b++) {
+        size_t count = b == 0 ? 3 * TRIANGLE_BATCH_LANES + 5 : 1000; // capacity of the second gets trimmed
+        triangle_batch_init(&batches[b], b == 0 ? count : 4096);
+        for (size_t j = 0; j < count; j++) {
+            triangle tri;
+            for (int i = 0; i < 3; i++) {
+                state ^= state << 13;
+                state ^= state >> 7;
+                state ^= state << 17;
+                tri.angles[i].value = (double)(state % 180);
+                tri.angles[i].is_known = (state >> 32) % 4 != 0;
+            }
+            triangle_batch_push(&batches[b], &tri);
+        }
+        errors += triangle_batch_file_append(fd, &batches[b]) != SC_RESULT_OK;
+        triangle_batch_complete_angles(&batches[b], 0, triangle_batch_words(&batches[b]));
+        triangle_batch_detect_right_angles(&batches[b], 0, triangle_batch_words(&batches[b]));
+    }
+    close(fd);
+
+    for (int writeback = 0; writeback <= 1; writeback++) {
+        for (int pass = 0; pass < 2; pass++) {
+            // Pass 0 processes the frames, pass 1 checks what the file kept
+            triangle_batch_file file;
+            errors += triangle_batch_file_map(&file, path, writeback) != SC_RESULT_OK;
+            triangle_batch mapped;
+            int frames = 0;
+            int status;
+            while ((status = triangle_batch_file_next(&file, &mapped)) == 1 && frames < 2) {
+                const triangle_batch* expected = &batches[frames++];
+                if (pass == 0) {
+                    triangle_batch_complete_angles(&mapped, 0, triangle_batch_words(&mapped));
+                    triangle_batch_detect_right_angles(&mapped, 0, triangle_batch_words(&mapped));
+                }
+                int processed = pass == 0 || writeback;
+                size_t words = triangle_batch_words(&mapped);
+                errors += mapped.count != expected->count;
+                errors += processed != (memcmp(mapped.is_right, expected->is_right, words * sizeof(uint64_t)) == 0);
+                for (int i = 0; i < 3; i++) {
+                    errors += memcmp(mapped.value[i], expected->value[i], mapped.count * sizeof(double)) != 0 &&
+                              processed;
+                }
+            }
+            errors += status != 0 || frames != 2;
+            triangle_batch_file_unmap(&file);
+        }
+    }
+    unlink(path);
+    triangle_batch_destroy(&batches[0]);
+    triangle_batch_destroy(&batches[1]);
+
+    printf("%-8s %s (2 frames mapped privately and with write-back)\n", "mapfile", errors == 0 ? "ok" : "MISMATCH");
+    return errors == 0;
+}
+
+// ==================== result writer ====================
+// Bulk output of processed triangles for large runs, where print_sc_memory's
+// printf per field would dominate. Records are formatted straight into one
+// reusable buffer that goes out with write() once full; a block larger than
+// the buffer is gathered with it into a single writev(). Nothing is allocated
+// after sc_out_init.
+//
+// CSV:    A,B,C,right - angles as in the ingest format ("?" if unknown), right 0/1
+// JSONL:  {"a":90,"b":45,"c":45,"right":true} - unknown angles are null
+// Binary: the 25-byte ingest record with bit 3 of the mask byte set for a
+//         right-angled triangle, so results can be ingested again
+#define SC_OUT_DEFAULT_CAPACITY (1 << 20)
+#define SC_OUT_DECIMALS 6   // fixed decimals of formatted angles, trailing zeros trimmed
+#define SC_OUT_MAX_RECORD 160
+
+typedef struct sc_out {
+    int fd;
+    char* buffer;
+    size_t used;
+    size_t capacity;
+    uint64_t bytes;   // handed to the kernel so far
+    sc_result result; // SC_RESULT_ERROR once a write failed
+} sc_out;
+
+typedef enum {
+    TRIANGLE_OUT_CSV,
+    TRIANGLE_OUT_JSONL,
+    TRIANGLE_OUT_BINARY
+} triangle_out_format;
+
+void sc_out_init(sc_out* out, int fd, size_t capacity) {
+    out->fd = fd;
+    out->capacity = capacity >= SC_OUT_MAX_RECORD ? capacity : SC_OUT_DEFAULT_CAPACITY;
+    out->buffer = malloc(out->capacity);
+    out->used = 0;
+    out->bytes = 0;
+    out->result = SC_RESULT_OK;
+}
+
+static void sc_out_send(sc_out* out, struct iovec* iov, int count) {
+    for (int i = 0; i < count; i++) {
+        out->bytes += iov[i].iov_len;
+    }
+    if (out->result == SC_RESULT_OK && sc_writev_all(out->fd, iov, count) != SC_RESULT_OK) {
+        out->result = SC_RESULT_ERROR;
+    }
+}
+
+sc_result sc_out_flush(sc_out* out) {
+    if (out->used > 0) {
+        struct iovec iov = { out->buffer, out->used };
+        sc_out_send(out, &iov, 1);
+        out->used = 0;
+    }
+    return out->result;
+}
+
+sc_result sc_out_destroy(sc_out* out) {
+    sc_result result = sc_out_flush(out);
+    free(out->buffer);
+    out->buffer = NULL;
+    return result;
+}
+
+void sc_out_write(sc_out* out, const void* data, size_t size) {
+    if (out->used + size <= out->capacity) {
+        memcpy(out->buffer + out->used, data, size);
+        out->used += size;
+    } else if (size >= out->capacity / 2) {
+        struct iovec iov[2] = { { out->buffer, out->used }, { (void*)data, size } };
+        sc_out_send(out, iov, 2);
+        out->used = 0;
+    } else {
+        sc_out_flush(out);
+        memcpy(out->buffer, data, size);
+        out->used = size;
+    }
+}
+
+// Room for at least size more bytes at out->buffer + out->used
+static inline char* sc_out_reserve(sc_out* out, size_t size) {
+    if (out->used + size > out->capacity) {
+        sc_out_flush(out);
+    }
+    return out->buffer + out->used;
+}
+
+static const double sc_out_scale[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9 };
+static const uint64_t sc_out_pow10[] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000,
+                                         1000000000 };
+
+// Formats value rounded to decimals (at most 9) places with trailing zeros
+// trimmed, like "%.*f" would after trimming; returns the length (at most 32).
+// Values too large for the integer path and non-finite ones use snprintf.
+//
+// The scaled product is rounded already, so when it lands within an ulp of
+// a half unit the direction is taken from the exact value instead: fma
+// gives the sign of value * scale - (lower + 0.5) without a second rounding.
+// Exact ties go to even, as glibc's printf does.
+size_t sc_format_double(char* out, double value, int decimals) {
+    if (!(fabs(value) < 1e15 / sc_out_scale[decimals])) {
+        return (size_t)snprintf(out, 32, "%.17g", value);
+    }
+    double product = fabs(value) * sc_out_scale[decimals];
+    double lower = floor(product);
+    uint64_t scaled;
+    if (fabs(product - lower - 0.5) <= product * DBL_EPSILON) {
+        double excess = fma(fabs(value), sc_out_scale[decimals], -(lower + 0.5));
+        scaled = (uint64_t)lower + (excess > 0.0 || (excess == 0.0 && ((uint64_t)lower & 1) != 0));
+    } else {
+        scaled = (uint64_t)nearbyint(product);
+    }
+    uint64_t integer = scaled / sc_out_pow10[decimals];
+    uint64_t fraction = scaled % sc_out_pow10[decimals];
+    char* p = out;
+    if (value < 0 && scaled != 0) {
+        *p++ = '-';
+    }
+    char digits[20];
+    int n = 0;
+    do {
+        digits[n++] = (char)('0' + integer % 10);
+        integer /= 10;
+    } while (integer != 0);
+    while (n > 0) {
+        *p++ = digits[--n];
+    }
+    if (fraction != 0) {
+        while (fraction % 10 == 0) {
+            fraction /= 10;
+            decimals--;
+        }
+        *p++ = '.';
+        for (int i = decimals - 1; i >= 0; i--) {
+            p[i] = (char)('0' + fraction % 10);
+            fraction /= 10;
+        }
+        p += decimals;
+    }
+    return (size_t)(p - out);
+}
+
+void triangle_out_header(sc_out* out, triangle_out_format format) {
+    if (format == TRIANGLE_OUT_CSV) {
+        sc_out_write(out, "a,b,c,right\n", 12);
+    }
+}
 
-typedef struct {
-    sc_memory_entry* entries;
-    size_t size;
-    size_t capacity;
-} sc_memory_context;
+void triangle_out_write(sc_out* out, triangle_out_format format, const triangle* tri, int is_right) {
+    char* p = sc_out_reserve(out, SC_OUT_MAX_RECORD);
+    char* start = p;
+    if (format == TRIANGLE_OUT_BINARY) {
+        unsigned char mask = (unsigned char)(is_right ? 8 : 0);
+        for (int i = 0; i < 3; i++) {
+            memcpy(p + i * sizeof(double), &tri->angles[i].value, sizeof(double));
+            mask |= (unsigned char)((tri->angles[i].is_known != 0) << i);
+        }
+        p[24] = (char)mask;
+        p += TRIANGLE_INGEST_RECORD_SIZE;
+    } else if (format == TRIANGLE_OUT_CSV) {
+        for (int i = 0; i < 3; i++) {
+            if (tri->angles[i].is_known) {
+                p += sc_format_double(p, tri->angles[i].value, SC_OUT_DECIMALS);
+            } else {
+                *p++ = '?';
+            }
+            *p++ = ',';
+        }
+        *p++ = is_right ? '1' : '0';
+        *p++ = '\n';
+    } else {
+        static const char* const keys[3] = { "{\"a\":", ",\"b\":", ",\"c\":" };
+        for (int i = 0; i < 3; i++) {
+            memcpy(p, keys[i], 5);
+            p += 5;
+            if (tri->angles[i].is_known && isfinite(tri->angles[i].value)) {
+                p += sc_format_double(p, tri->angles[i].value, SC_OUT_DECIMALS);
+            } else {
+                memcpy(p, "null", 4);
+                p += 4;
+            }
+        }
+        const char* tail = is_right ? ",\"right\":true}\n" : ",\"right\":false}\n";
+        size_t len = strlen(tail);
+        memcpy(p, tail, len);
+        p += len;
+    }
+    out->used += (size_t)(p - start);
+}
 
-void sc_memory_init(sc_memory_context* ctx, size_t initial_capacity) {
-    ctx->entries = malloc(initial_capacity * sizeof(sc_memory_entry));
-    ctx->size = 0;
-    ctx->capacity = initial_capacity;
+// Every triangle of a processed batch with its is_right bit
+void triangle_out_write_batch(sc_out* out, int format, const triangle_batch* batch) {
+    for (size_t j = 0; j < batch->count; j++) {
+        triangle tri;
+        triangle_batch_get(batch, j, &tri);
+        int is_right = (int)((batch->is_right[j / TRIANGLE_BATCH_LANES] >> (j % TRIANGLE_BATCH_LANES)) & 1);
+        triangle_out_write(out, format, &tri, is_right);
+    }
 }
 
-void sc_memory_store(sc_memory_context* ctx, const char* addr, void* data, const char* type) {
-    // Check if addr already exists and update
+// Every triangle of ctx, including those inside batch elements. Single
+// triangles are written as stored, with the right-angle test of
+// check_right_angle_agent_execute on their known angles.
+void triangle_out_write_memory(sc_out* out, triangle_out_format format, sc_memory_context* ctx) {
     for (size_t i = 0; i < ctx->size; i++) {
-        if (strcmp(ctx->entries[i].addr, addr) == 0) {
-            ctx->entries[i].data = data;
-            ctx->entries[i].type = strdup(type);
-            return;
+        sc_memory_entry* entry = &ctx->entries[i];
+        if (entry->type == sc_type_triangle) {
+            const triangle* tri = sc_memory_entry_data(entry);
+            triangle_out_write(out, format, tri, triangle_has_right_angle(tri));
+        } else if (entry->type == sc_type_triangle_batch) {
+            triangle_out_write_batch(out, format, sc_memory_entry_data(entry));
         }
     }
+}
 
-    // Resize if necessary
-    if (ctx->size >= ctx->capacity) {
-        ctx->capacity *= 2;
-        ctx->entries = realloc(ctx->entries, ctx->capacity * sizeof(sc_memory_entry));
+// Whether sc_format_double agrees with trimmed "%.*f" output for value
+static int sc_format_double_matches(double value) {
+    char fast[40], slow[40];
+    fast[sc_format_double(fast, value, SC_OUT_DECIMALS)] = '\0';
+    snprintf(slow, sizeof(slow), "%.*f", SC_OUT_DECIMALS, value);
+    size_t len = strlen(slow);
+    while (slow[len - 1] == '0') {
+        slow[--len] = '\0';
     }
-
-    // Add new entry
-    ctx->entries[ctx->size].addr = strdup(addr);
-    ctx->entries[ctx->size].data = data;
-    ctx->entries[ctx->size].type = strdup(type);
-    ctx->size++;
+    if (slow[len - 1] == '.') {
+        slow[--len] = '\0';
+    }
+    return strcmp(fast, strcmp(slow, "-0") == 0 ? "0" : slow) == 0;
 }
 
-void* sc_memory_get(sc_memory_context* ctx, const char* addr, const char* type) {
-    for (size_t i = 0; i < ctx->size; i++) {
-        if (strcmp(ctx->entries[i].addr, addr) == 0) {
-            if (strcmp(ctx->entries[i].type, type) != 0) {
-                fprintf(stderr, "Type mismatch for SC element: %s\n", addr);
-                exit(EXIT_FAILURE);
+// Writes a processed batch in every format, checks the fixed-point formatter
+// against printf and reads the CSV and binary output back through ingest
+int triangle_out_selftest(void) {
+    int errors = 0;
+    uint64_t state = 0xda3e39cb94b95bdbull;
+    for (int k = 0; k < 100000; k++) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        // Dyadic values, exact in binary, and decimal near-ties (k + 0.5) * 1e-6
+        errors += !sc_format_double_matches((double)(int64_t)(state % 2000000001ull - 1000000000ull) / 8192.0);
+        errors += !sc_format_double_matches((double)(int64_t)(state % 2000000001ull - 1000000000ull) / 1e6 + 5e-7);
+    }
+    errors += !sc_format_double_matches(61.6927775) + !sc_format_double_matches(98.7228625) +
+              !sc_format_double_matches(56.5166495) + !sc_format_double_matches(0.0000005);
+
+    triangle_batch batch;
+    triangle_batch_init(&batch, 5000);
+    for (size_t j = 0; j < 5000; j++) {
+        triangle tri;
+        for (int i = 0; i < 3; i++) {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            tri.angles[i].value = (double)(state % 18000) / 100.0;
+            tri.angles[i].is_known = (state >> 32) % 4 != 0;
+        }
+        triangle_batch_push(&batch, &tri);
+    }
+    triangle_batch_complete_angles(&batch, 0, triangle_batch_words(&batch));
+    triangle_batch_detect_right_angles(&batch, 0, triangle_batch_words(&batch));
+
+    triangle_ingest_collector collector = { malloc(batch.count * sizeof(triangle)), 0, batch.count };
+    triangle* expected = malloc(batch.count * sizeof(triangle));
+    for (size_t j = 0; j < batch.count; j++) {
+        triangle_batch_get(&batch, j, &expected[j]);
+    }
+    size_t bytes[3] = { 0, 0, 0 };
+    for (int format = TRIANGLE_OUT_CSV; format <= TRIANGLE_OUT_BINARY; format++) {
+        FILE* file = tmpfile();
+        sc_out out;
+        sc_out_init(&out, fileno(file), 4096); // small, so flushes and writev happen
+        triangle_out_header(&out, format);
+        triangle_out_write_batch(&out, format, &batch);
+        errors += sc_out_destroy(&out) != SC_RESULT_OK;
+        bytes[format] = out.bytes;
+
+        lseek(fileno(file), 0, SEEK_SET);
+        triangle_ingest_stats stats;
+        collector.count = 0;
+        if (format == TRIANGLE_OUT_CSV) {
+            errors += triangle_ingest_csv(fileno(file), 1024, triangle_ingest_collect, &collector, &stats) !=
+                      SC_RESULT_OK || stats.rejected != 0 || collector.count != batch.count;
+            for (size_t j = 0; j < collector.count; j++) {
+                for (int i = 0; i < 3; i++) {
+                    // Six decimals are plenty for these angles, but not a round trip
+                    errors += collector.triangles[j].angles[i].is_known != expected[j].angles[i].is_known ||
+                              (expected[j].angles[i].is_known &&
+                               fabs(collector.triangles[j].angles[i].value - expected[j].angles[i].value) > 1e-6);
+                }
             }
-            return ctx->entries[i].data;
+        } else if (format == TRIANGLE_OUT_BINARY) {
+            errors += triangle_ingest_binary(fileno(file), 1024, triangle_ingest_collect, &collector, &stats) !=
+                      SC_RESULT_OK || stats.rejected != 0;
+            errors += triangle_ingest_mismatches(collector.triangles, expected, batch.count);
         }
+        fclose(file);
     }
-    return NULL;
-}
+    errors += bytes[TRIANGLE_OUT_BINARY] != batch.count * TRIANGLE_INGEST_RECORD_SIZE;
 
-void sc_log_event(const char* msg) {
-    printf("[SC] %s\n", msg);
+    // A stored triangle that was never completed keeps the flag of its known angles
+    sc_memory_context ctx;
+    sc_memory_init(&ctx, 4);
+    triangle isosceles = { { {45.0, 1}, {45.0, 1}, {0.0, 0} } };
+    sc_memory_store(&ctx, "input_triangle", &isosceles, "triangle");
+    FILE* file = tmpfile();
+    sc_out out;
+    sc_out_init(&out, fileno(file), 4096);
+    triangle_out_write_memory(&out, TRIANGLE_OUT_CSV, &ctx);
+    errors += sc_out_destroy(&out) != SC_RESULT_OK;
+    char row[64] = { 0 };
+    lseek(fileno(file), 0, SEEK_SET);
+    errors += read(fileno(file), row, sizeof(row) - 1) < 0 || strcmp(row, "45,45,?,0\n") != 0;
+    fclose(file);
+    sc_memory_destroy(&ctx);
+
+    printf("%-8s %s (%zu triangles: %llu CSV, %llu JSONL, %llu binary bytes)\n", "writer",
+           errors == 0 ? "ok" : "MISMATCH", batch.count, (unsigned long long)bytes[0], (unsigned long long)bytes[1],
+           (unsigned long long)bytes[2]);
+    free(collector.triangles);
+    free(expected);
+    triangle_batch_destroy(&batch);
+    return errors == 0;
 }
 
-// ==================== domains ====================
+// ==================== triangle generator ====================
+// Seeded synthetic triangle streams for load tests. The same config and seed
+// always give the same sequence. Angles are multiples of 0.001 degrees so they
+// survive the CSV round trip exactly.
+#define TRIANGLE_GEN_RECENT 64 // duplicates repeat one of the last 64 triangles
+
 typedef struct {
-    double value;
-    int is_known;
-} angle;
+    uint64_t seed;
+    double two_unknown;   // fraction with two unknown angles (invalid)
+    double none_unknown;  // fraction with every angle known (invalid); the rest has one unknown
+    double right;         // fraction of right-angled triangles
+    double duplicate;     // probability of repeating a recent triangle
+    size_t recurring;     // draw from this many fixed triples; 0 draws every triple at random
+} triangle_gen_config;
 
 typedef struct {
-    angle angles[3]; // angles[0] - A, angles[1] - B, angles[2] - C
-} triangle;
+    triangle_gen_config config;
+    uint64_t state;
+    triangle* triples;    // config.recurring complete triangles
+    triangle recent[TRIANGLE_GEN_RECENT];
+    size_t generated;
+} triangle_gen;
 
-// ==================== agents ====================
-sc_result calculate_angles_agent_execute(sc_memory_context* ctx) {
-    triangle* tri = sc_memory_get(ctx, "input_triangle", "triangle");
-    // rules_set not used in this agent
+static const triangle_gen_config triangle_gen_defaults = { 1, 0.0, 0.0, 0.5, 0.0, 0 };
 
-    int unknown_count = 0;
-    double sum_known = 0.0;
+// xorshift64*
+static inline uint64_t triangle_gen_random(triangle_gen* gen) {
+    gen->state ^= gen->state >> 12;
+    gen->state ^= gen->state << 25;
+    gen->state ^= gen->state >> 27;
+    return gen->state * 0x2545f4914f6cdd1dull;
+}
+
+// Uniform in [0, 1)
+static inline double triangle_gen_uniform(triangle_gen* gen) {
+    return (double)(triangle_gen_random(gen) >> 11) * 0x1.0p-53;
+}
+
+// Uniform multiple of 0.001 in [lo, hi], both multiples of 0.001 themselves
+static inline double triangle_gen_angle(triangle_gen* gen, double lo, double hi) {
+    uint64_t steps = (uint64_t)llround((hi - lo) * 1000.0) + 1;
+    return (double)(llround(lo * 1000.0) + (int64_t)(triangle_gen_random(gen) % steps)) / 1000.0;
+}
 
+// A complete triangle with angles summing to 180, right-angled or clearly not
+static void triangle_gen_complete(triangle_gen* gen, triangle* tri) {
+    double a, b, c;
+    if (triangle_gen_uniform(gen) < gen->config.right) {
+        a = 90.0;
+        b = triangle_gen_angle(gen, 0.001, 89.999);
+    } else {
+        do {
+            a = triangle_gen_angle(gen, 0.001, 179.998);
+            b = triangle_gen_angle(gen, 0.001, 179.999 - a);
+        } while (fabs(a - 90.0) < 1.0 || fabs(b - 90.0) < 1.0 || fabs(180.0 - a - b - 90.0) < 1.0);
+    }
+    c = (double)(180000 - llround(a * 1000.0) - llround(b * 1000.0)) / 1000.0;
+    // The right angle may sit in any position
+    size_t shift = (size_t)(triangle_gen_random(gen) % 3);
+    double angles[3] = { a, b, c };
     for (int i = 0; i < 3; i++) {
-        if (tri->angles[i].is_known) {
-            sum_known += tri->angles[i].value;
+        tri->angles[i].value = angles[(i + shift) % 3];
+        tri->angles[i].is_known = 1;
+    }
+}
+
+void triangle_gen_init(triangle_gen* gen, const triangle_gen_config* config) {
+    gen->config = *config;
+    gen->state = config->seed != 0 ? config->seed : 0x9e3779b97f4a7c15ull; // xorshift needs a non-zero state
+    gen->generated = 0;
+    gen->triples = NULL;
+    if (config->recurring > 0) {
+        gen->triples = malloc(config->recurring * sizeof(triangle));
+        if (gen->triples == NULL) {
+            fprintf(stderr, "Triangle generator out of memory\n");
+            exit(EXIT_FAILURE);
+        }
+        for (size_t k = 0; k < config->recurring; k++) {
+            triangle_gen_complete(gen, &gen->triples[k]);
+        }
+    }
+}
+
+void triangle_gen_destroy(triangle_gen* gen) {
+    free(gen->triples);
+    gen->triples = NULL;
+}
+
+void triangle_gen_next(triangle_gen* gen, triangle* tri) {
+    size_t recent = gen->generated < TRIANGLE_GEN_RECENT ? gen->generated : TRIANGLE_GEN_RECENT;
+    if (recent > 0 && triangle_gen_uniform(gen) < gen->config.duplicate) {
+        *tri = gen->recent[triangle_gen_random(gen) % recent];
+    } else {
+        if (gen->triples != NULL) {
+            *tri = gen->triples[triangle_gen_random(gen) % gen->config.recurring];
         } else {
-            unknown_count++;
+            triangle_gen_complete(gen, tri);
+        }
+        double kind = triangle_gen_uniform(gen);
+        int unknowns = kind < gen->config.two_unknown                                ? 2
+                       : kind < gen->config.two_unknown + gen->config.none_unknown ? 0
+                                                                                     : 1;
+        size_t first = (size_t)(triangle_gen_random(gen) % 3);
+        for (int u = 0; u < unknowns; u++) {
+            tri->angles[(first + (size_t)u) % 3].value = 0.0;
+            tri->angles[(first + (size_t)u) % 3].is_known = 0;
         }
     }
+    gen->recent[gen->generated % TRIANGLE_GEN_RECENT] = *tri;
+    gen->generated++;
+}
 
-    if (unknown_count == 1) {
-        for (int i = 0; i < 3; i++) {
-            if (!tri->angles[i].is_known) {
-                tri->angles[i].value = 180.0 - sum_known;
-                tri->angles[i].is_known = 1;
-                char msg[100];
-                snprintf(msg, sizeof(msg), "Calculated angle: %.2f°", tri->angles[i].value);
-                sc_log_event(msg);
-                return SC_RESULT_OK;
-            }
+// Hands count triangles to fn in batches of batch_size, like the ingest readers
+sc_result triangle_gen_batches(triangle_gen* gen, size_t count, size_t batch_size, triangle_ingest_fn fn, void* arg) {
+    triangle_batch batch;
+    triangle_batch_init(&batch, batch_size);
+    sc_result result = SC_RESULT_OK;
+    for (size_t j = 0; j < count && result == SC_RESULT_OK; j++) {
+        triangle tri;
+        triangle_gen_next(gen, &tri);
+        triangle_batch_push(&batch, &tri);
+        if (batch.count == batch_size || j + 1 == count) {
+            result = fn(arg, &batch) ? SC_RESULT_OK : SC_RESULT_ERROR;
+            triangle_batch_clear(&batch);
         }
     }
+    triangle_batch_destroy(&batch);
+    return result;
+}
 
-    sc_log_event("Angle calculation error");
-    return SC_RESULT_ERROR;
+// Field-wise, as the struct has padding
+static int triangle_gen_same(const triangle* a, const triangle* b) {
+    for (int i = 0; i < 3; i++) {
+        if (a->angles[i].value != b->angles[i].value || a->angles[i].is_known != b->angles[i].is_known) {
+            return 0;
+        }
+    }
+    return 1;
 }
 
-sc_result check_right_angle_agent_execute(sc_memory_context* ctx) {
-    triangle* tri = sc_memory_get(ctx, "input_triangle", "triangle");
-    // rules_set not used in this agent
+// Checks reproducibility and that the generated mix follows the config
+int triangle_gen_selftest(void) {
+    const size_t count = 100000;
+    triangle_gen_config config = { 42, 0.1, 0.05, 0.3, 0.2, 0 };
+    triangle_gen first, second;
+    triangle_gen_init(&first, &config);
+    triangle_gen_init(&second, &config);
+    size_t unknowns[4] = { 0 };
+    size_t right = 0;
+    size_t bad_sum = 0;
+    int errors = 0;
+    for (size_t j = 0; j < count; j++) {
+        triangle a, b;
+        triangle_gen_next(&first, &a);
+        triangle_gen_next(&second, &b);
+        errors += !triangle_gen_same(&a, &b);
+        int missing = !a.angles[0].is_known + !a.angles[1].is_known + !a.angles[2].is_known;
+        unknowns[missing]++;
+        if (missing == 1) {
+            triangle_memo_entry result;
+            triangle_classify(&a, &result);
+            right += result.completed_is_right;
+            bad_sum += result.calculated != SC_RESULT_OK;
+        }
+    }
+    triangle_gen_destroy(&first);
+    triangle_gen_destroy(&second);
+    // Duplicates keep the mix, so every fraction holds within sampling noise
+    double n = (double)count;
+    errors += fabs((double)unknowns[2] / n - 0.1) > 0.01 || fabs((double)unknowns[0] / n - 0.05) > 0.01;
+    errors += unknowns[3] != 0 || bad_sum != 0;
+    errors += fabs((double)right / (double)unknowns[1] - 0.3) > 0.01;
 
-    for (int i = 0; i < 3; i++) {
-        if (tri->angles[i].is_known && fabs(tri->angles[i].value - 90.0) < 0.001) {
-            int is_right = 1;
-            sc_memory_store(ctx, "is_right_triangle", &is_right, "int");
-            sc_log_event("Right angle detected (90°)");
-            return SC_RESULT_OK;
+    // A recurring set of 4 triples yields at most 4 distinct complete triangles
+    config = (triangle_gen_config){ 7, 0.0, 1.0, 0.5, 0.0, 4 };
+    triangle_gen_init(&first, &config);
+    triangle seen[5];
+    size_t distinct = 0;
+    for (size_t j = 0; j < 1000 && distinct < 5; j++) {
+        triangle tri;
+        triangle_gen_next(&first, &tri);
+        size_t k = 0;
+        while (k < distinct && !triangle_gen_same(&seen[k], &tri)) {
+            k++;
+        }
+        if (k == distinct) {
+            seen[distinct++] = tri;
         }
     }
+    triangle_gen_destroy(&first);
+    errors += distinct > 4;
 
-    int is_right = 0;
-    sc_memory_store(ctx, "is_right_triangle", &is_right, "int");
-    return SC_RESULT_OK;
+    printf("%-8s %s (%zu triangles: %zu one, %zu two, %zu no unknown, %zu right)\n", "gen",
+           errors == 0 ? "ok" : "MISMATCH", count, unknowns[1], unknowns[2], unknowns[0], right);
+    return errors == 0;
 }
 
-sc_result triangle_processing_agent_execute(sc_memory_context* ctx) {
-    sc_log_event("Starting triangle processing");
+// ==================== benchmarks ====================
+// Microbenchmarks for the memory core and the agents. Every case runs one
+// untimed warmup pass and `repeats` timed passes; throughput is the median,
+// min and max over the passes, and latency percentiles come from one more
+// pass that times every stride-th operation on its own. Results are written
+// to stdout as one JSON object per line.
+#define SC_BENCH_MIN_OPS (1u << 20)      // per pass, so small contexts are looped
+#define SC_BENCH_LATENCY_SAMPLES 100000
+#define SC_BENCH_SHORT_KEY 8
+#define SC_BENCH_LONG_KEY 64
+#define SC_BENCH_LONG_KEY_MAX 1000000    // long keys stop here to bound key memory
+#define SC_BENCH_BATCH 4096
 
-    if (calculate_angles_agent_execute(ctx) != SC_RESULT_OK) {
-        return SC_RESULT_ERROR;
+typedef struct sc_bench sc_bench;
+
+struct sc_bench {
+    const char* name;
+    size_t entries;          // elements in the context under test
+    size_t key_len;          // 0 when no keys are involved
+    double hit_ratio;        // negative when not a lookup
+    size_t items_per_op;     // triangles per operation for batch cases
+    size_t round_ops;        // operations between two round_setup calls
+    size_t rounds;
+    void (*round_setup)(sc_bench* bench);  // untimed, NULL if none
+    void (*op)(sc_bench* bench, size_t i);
+    sc_memory_context ctx;
+    const char* keys;        // entries present keys, then entries absent keys
+    const char** sequence;   // lookup order for get cases
+    triangle_batch batch;
+    triangle_batch pristine; // batch contents before processing
+    triangle_ingest_pipeline pipeline;
+    uint64_t sink;           // keeps results observable
+};
+
+static inline const char* sc_bench_key(const sc_bench* bench, size_t i) {
+    return bench->keys + i * (bench->key_len + 1);
+}
+
+// Fixed-length keys "k<hex>" for present elements and "m<hex>" for absent ones
+static char* sc_bench_keys(size_t entries, size_t key_len) {
+    char* keys = malloc(2 * entries * (key_len + 1));
+    if (keys == NULL) {
+        fprintf(stderr, "Benchmark keys out of memory\n");
+        exit(EXIT_FAILURE);
     }
+    for (size_t i = 0; i < 2 * entries; i++) {
+        snprintf(keys + i * (key_len + 1), key_len + 1, "%c%0*zx", i < entries ? 'k' : 'm', (int)key_len - 1,
+                 i % entries);
+    }
+    return keys;
+}
 
-    if (check_right_angle_agent_execute(ctx) != SC_RESULT_OK) {
-        return SC_RESULT_ERROR;
+// Scatters consecutive operations over [0, n) so lookups do not walk memory in order
+static inline size_t sc_bench_scatter(size_t i, size_t n) {
+    return (size_t)(((uint64_t)i * 0x9e3779b97f4a7c15ull) >> 17) % n;
+}
+
+static void sc_bench_fill(sc_bench* bench) {
+    for (size_t i = 0; i < bench->entries; i++) {
+        int value = (int)i;
+        sc_memory_store(&bench->ctx, sc_bench_key(bench, i), &value, "int");
     }
+}
 
-    int* is_right = sc_memory_get(ctx, "is_right_triangle", "int");
-    sc_log_event(*is_right ? "Triangle is right-angled" : "Triangle is not right-angled");
-    
-    return SC_RESULT_OK;
+static void sc_bench_fresh_context(sc_bench* bench) {
+    sc_memory_destroy(&bench->ctx);
+    sc_memory_init(&bench->ctx, 1);
+}
+
+static void sc_bench_insert(sc_bench* bench, size_t i) {
+    int value = (int)i;
+    sc_memory_store(&bench->ctx, sc_bench_key(bench, i), &value, "int");
+}
+
+static void sc_bench_overwrite(sc_bench* bench, size_t i) {
+    int value = (int)(i + bench->sink++); // always differs from the stored value
+    sc_memory_store(&bench->ctx, sc_bench_key(bench, sc_bench_scatter(i, bench->entries)), &value, "int");
+}
+
+static void sc_bench_get(sc_bench* bench, size_t i) {
+    int* value = sc_memory_get(&bench->ctx, bench->sequence[i], "int");
+    bench->sink += value != NULL ? (uint64_t)*value : 1;
+}
+
+static const triangle sc_bench_triangles[2] = {
+    { { {90.0, 1}, {45.0, 1}, {0.0, 0} } },
+    { { {60.0, 1}, {0.0, 0}, {60.0, 1} } },
+};
+
+// Alternates two triangles so every run sees a changed input
+static void sc_bench_agents(sc_bench* bench, size_t i) {
+    sc_memory_store(&bench->ctx, "input_triangle", &sc_bench_triangles[i & 1], "triangle");
+    bench->sink += triangle_processing_agent_execute(&bench->ctx) == SC_RESULT_OK;
+}
+
+// Unchanged input: measures the cost of skipping every agent
+static void sc_bench_agents_idle(sc_bench* bench, size_t i) {
+    (void)i;
+    bench->sink += triangle_processing_agent_execute(&bench->ctx) == SC_RESULT_OK;
+}
+
+// The agent completes the batch in place, so every operation starts from a fresh copy
+static void sc_bench_batch_restore(sc_bench* bench) {
+    memcpy(bench->batch.value[0], bench->pristine.value[0], triangle_batch_bytes(bench->batch.capacity));
+    bench->batch.count = bench->pristine.count;
+}
+
+static void sc_bench_batch(sc_bench* bench, size_t i) {
+    (void)i;
+    triangle_ingest_pipeline_push(&bench->pipeline, &bench->batch);
+}
+
+static uint64_t sc_bench_pass(sc_bench* bench) {
+    uint64_t elapsed = 0;
+    for (size_t r = 0; r < bench->rounds; r++) {
+        if (bench->round_setup != NULL) {
+            bench->round_setup(bench);
+        }
+        uint64_t start = sc_now_ns();
+        for (size_t i = 0; i < bench->round_ops; i++) {
+            bench->op(bench, i);
+        }
+        elapsed += sc_now_ns() - start;
+    }
+    return elapsed;
+}
+
+static int sc_bench_compare_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+// Median cost of reading the clock twice, subtracted from each latency sample
+static uint64_t sc_bench_timer_overhead(void) {
+    uint64_t samples[1001];
+    for (size_t s = 0; s < 1001; s++) {
+        uint64_t start = sc_now_ns();
+        samples[s] = sc_now_ns() - start;
+    }
+    qsort(samples, 1001, sizeof(samples[0]), sc_bench_compare_u64);
+    return samples[500];
+}
+
+static uint64_t sc_bench_percentile(const uint64_t* sorted, size_t count, double p) {
+    return count == 0 ? 0 : sorted[(size_t)(p * (double)(count - 1) + 0.5)];
+}
+
+static void sc_bench_run(sc_bench* bench, unsigned repeats, uint64_t timer_overhead) {
+    size_t total_ops = bench->round_ops * bench->rounds;
+    sc_bench_pass(bench); // warmup: faults pages in, trains caches and predictors
+
+    double* mitems = malloc(repeats * sizeof(double));
+    for (unsigned r = 0; r < repeats; r++) {
+        uint64_t elapsed = sc_bench_pass(bench);
+        mitems[r] = (double)(total_ops * bench->items_per_op) * 1e3 / (double)(elapsed ? elapsed : 1);
+    }
+    for (unsigned r = 1; r < repeats; r++) { // insertion sort; repeats is small
+        for (unsigned k = r; k > 0 && mitems[k - 1] > mitems[k]; k--) {
+            double swap = mitems[k];
+            mitems[k] = mitems[k - 1];
+            mitems[k - 1] = swap;
+        }
+    }
+
+    size_t stride = (total_ops + SC_BENCH_LATENCY_SAMPLES - 1) / SC_BENCH_LATENCY_SAMPLES;
+    uint64_t* latency = malloc((total_ops / stride + 1) * sizeof(uint64_t));
+    size_t samples = 0;
+    for (size_t r = 0; r < bench->rounds; r++) {
+        if (bench->round_setup != NULL) {
+            bench->round_setup(bench);
+        }
+        for (size_t i = 0; i < bench->round_ops; i++) {
+            if ((r * bench->round_ops + i) % stride != 0) {
+                bench->op(bench, i);
+                continue;
+            }
+            uint64_t start = sc_now_ns();
+            bench->op(bench, i);
+            uint64_t elapsed = sc_now_ns() - start;
+            latency[samples++] = elapsed > timer_overhead ? elapsed - timer_overhead : 0;
+        }
+    }
+    qsort(latency, samples, sizeof(latency[0]), sc_bench_compare_u64);
+
+    printf("{\"bench\":\"%s\",\"entries\":%zu,\"key_len\":%zu,\"hit_ratio\":", bench->name, bench->entries,
+           bench->key_len);
+    if (bench->hit_ratio < 0) {
+        printf("null");
+    } else {
+        printf("%.2f", bench->hit_ratio);
+    }
+    printf(",\"repeats\":%u,\"ops\":%zu,\"items_per_op\":%zu,\"mitems_s_median\":%.3f,\"mitems_s_min\":%.3f,"
+           "\"mitems_s_max\":%.3f,\"p50_ns\":%llu,\"p90_ns\":%llu,\"p99_ns\":%llu,\"p999_ns\":%llu}\n",
+           repeats, total_ops, bench->items_per_op, mitems[repeats / 2], mitems[0], mitems[repeats - 1],
+           (unsigned long long)sc_bench_percentile(latency, samples, 0.5),
+           (unsigned long long)sc_bench_percentile(latency, samples, 0.9),
+           (unsigned long long)sc_bench_percentile(latency, samples, 0.99),
+           (unsigned long long)sc_bench_percentile(latency, samples, 0.999));
+    fflush(stdout);
+    free(latency);
+    free(mitems);
+}
+
+static void sc_bench_memory(size_t entries, size_t key_len, unsigned repeats, uint64_t timer_overhead) {
+    sc_bench bench = { 0 };
+    bench.entries = entries;
+    bench.key_len = key_len;
+    bench.items_per_op = 1;
+    bench.keys = sc_bench_keys(entries, key_len);
+    sc_memory_init(&bench.ctx, 1);
+
+    // Insert into a fresh context, growth included; small sizes loop over many contexts
+    bench.name = "store_insert";
+    bench.hit_ratio = -1;
+    bench.round_ops = entries;
+    bench.rounds = (SC_BENCH_MIN_OPS / 4 + entries - 1) / entries;
+    bench.round_setup = sc_bench_fresh_context;
+    bench.op = sc_bench_insert;
+    sc_bench_run(&bench, repeats, timer_overhead);
+
+    sc_bench_fresh_context(&bench);
+    sc_bench_fill(&bench);
+    bench.round_ops = entries > SC_BENCH_MIN_OPS ? entries : SC_BENCH_MIN_OPS;
+    bench.rounds = 1;
+    bench.round_setup = NULL;
+    bench.name = "store_overwrite";
+    bench.op = sc_bench_overwrite;
+    sc_bench_run(&bench, repeats, timer_overhead);
+
+    static const double hit_ratios[] = { 1.0, 0.5, 0.0 };
+    bench.sequence = malloc(bench.round_ops * sizeof(const char*));
+    bench.name = "get";
+    bench.op = sc_bench_get;
+    for (size_t h = 0; h < sizeof(hit_ratios) / sizeof(hit_ratios[0]); h++) {
+        bench.hit_ratio = hit_ratios[h];
+        for (size_t i = 0; i < bench.round_ops; i++) {
+            size_t key = sc_bench_scatter(i, entries);
+            int hit = (double)(sc_bench_scatter(i + 1, 1000)) < hit_ratios[h] * 1000.0;
+            bench.sequence[i] = sc_bench_key(&bench, hit ? key : entries + key);
+        }
+        sc_bench_run(&bench, repeats, timer_overhead);
+    }
+
+    // The full triangle pipeline in a context already holding `entries` elements
+    if (key_len == SC_BENCH_SHORT_KEY) {
+        int rules = 0;
+        sc_memory_store(&bench.ctx, "rules_set", &rules, "rules_set");
+        bench.key_len = 0;
+        bench.hit_ratio = -1;
+        bench.round_ops = SC_BENCH_MIN_OPS / 4;
+        bench.name = "agents";
+        bench.op = sc_bench_agents;
+        sc_bench_run(&bench, repeats, timer_overhead);
+
+        triangle_memo_configure(0);
+        bench.name = "agents_nomemo";
+        sc_bench_run(&bench, repeats, timer_overhead);
+        triangle_memo_configure(TRIANGLE_MEMO_DEFAULT_CAPACITY);
+
+        sc_stats_enable(1);
+        bench.name = "agents_stats";
+        sc_bench_run(&bench, repeats, timer_overhead);
+        sc_stats_enable(0);
+
+        bench.name = "agents_idle";
+        bench.op = sc_bench_agents_idle;
+        sc_bench_run(&bench, repeats, timer_overhead);
+    }
+
+    sc_memory_destroy(&bench.ctx);
+    free(bench.sequence);
+    free((char*)bench.keys);
+}
+
+// Batch pipeline on a pinned pool, SC_BENCH_BATCH triangles per operation
+static void sc_bench_batches(size_t workers, unsigned repeats, uint64_t timer_overhead) {
+    sc_bench bench = { 0 };
+    bench.name = workers == 0 ? "batch_inline" : "batch_pool";
+    bench.entries = 1;
+    bench.hit_ratio = -1;
+    bench.items_per_op = SC_BENCH_BATCH;
+    bench.round_ops = 1;
+    bench.rounds = 256;
+    bench.round_setup = sc_bench_batch_restore;
+    bench.op = sc_bench_batch;
+    sc_memory_init(&bench.ctx, 10);
+    triangle_batch_init(&bench.batch, SC_BENCH_BATCH);
+    triangle_batch_init(&bench.pristine, SC_BENCH_BATCH);
+    uint64_t state = 0x2545f4914f6cdd1dull;
+    for (size_t j = 0; j < SC_BENCH_BATCH; j++) {
+        triangle tri;
+        for (int i = 0; i < 3; i++) {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            tri.angles[i].value = (double)(state % 180);
+            tri.angles[i].is_known = (state >> 32) % 4 != 0;
+        }
+        triangle_batch_push(&bench.pristine, &tri);
+    }
+    sc_thread_pool pool;
+    if (workers > 0) {
+        sc_thread_pool_init(&pool, workers);
+        sc_thread_pool_pin(&pool, 1); // CPU 0 belongs to the benchmark thread
+    }
+    bench.pipeline = (triangle_ingest_pipeline){ &bench.ctx, workers > 0 ? &pool : NULL, 0, 0, NULL, 0, { 0 } };
+    sc_bench_run(&bench, repeats, timer_overhead);
+
+    if (workers > 0) {
+        sc_thread_pool_destroy(&pool);
+    }
+    triangle_batch_destroy(&bench.batch);
+    triangle_batch_destroy(&bench.pristine);
+    sc_memory_destroy(&bench.ctx);
+}
+
+// Runs every case for context sizes 10, 1k, 100k, 1M and 10M up to max_entries
+void sc_bench_all(size_t max_entries, unsigned repeats) {
+    static const size_t sizes[] = { 10, 1000, 100000, 1000000, 10000000 };
+    sc_log_set_level(SC_LOG_LEVEL_WARN);
+    sc_thread_pin(pthread_self(), 0);
+    uint64_t timer_overhead = sc_bench_timer_overhead();
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]) && sizes[s] <= max_entries; s++) {
+        sc_bench_memory(sizes[s], SC_BENCH_SHORT_KEY, repeats, timer_overhead);
+        if (sizes[s] <= SC_BENCH_LONG_KEY_MAX) {
+            sc_bench_memory(sizes[s], SC_BENCH_LONG_KEY, repeats, timer_overhead);
+        }
+    }
+    sc_bench_batches(0, repeats, timer_overhead);
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    sc_bench_batches(cpus > 1 ? (size_t)cpus - 1 : 1, repeats, timer_overhead);
 }
 
 // ==================== CLI UI SClang-like ====================
 void print_sc_memory(sc_memory_context* ctx) {
     printf("=== SC Memory Dump ===\n");
     for (size_t i = 0; i < ctx->size; i++) {
+        if (ctx->entries[i].type == SC_TYPE_NONE) {
+            continue;
+        }
         printf("%20s: ", ctx->entries[i].addr);
-        if (strcmp(ctx->entries[i].type, "triangle") == 0) {
-            triangle* tri = ctx->entries[i].data;
-            printf("Triangle(");
-            for (int j = 0; j < 3; j++) {
-                printf(tri->angles[j].is_known ? "%.2f " : "? ", tri->angles[j].value);
-            }
-            printf(")");
-        } else if (strcmp(ctx->entries[i].type, "int") == 0) {
-            int* val = ctx->entries[i].data;
-            printf(*val ? "true" : "false");
-        } else if (strcmp(ctx->entries[i].type, "rules_set") == 0) {
-            printf("RulesSet");
+        const sc_type_ops* ops = sc_type_get_ops(ctx->entries[i].type);
+        if (ops->print != NULL) {
+            ops->print(stdout, sc_memory_entry_data(&ctx->entries[i]), ctx->entries[i].size);
+        } else {
+            printf("%s", sc_type_name(ctx->entries[i].type));
         }
         printf("\n");
     }
@@ -169,8 +5955,313 @@ void print_sc_memory(sc_memory_context* ctx) {
 }
 
 // ==================== Testing ====================
-int main() {
-    // Initialize SC memory
+// Long-running modes count agent calls; SIGUSR1 dumps the counters to stderr,
+// and so does exit when TRIANGLE_STATS is set
+static void cli_stats_start(void) {
+    sc_stats_install_signal();
+    sc_stats_enable(1);
+}
+
+static void cli_stats_finish(void) {
+    if (getenv("TRIANGLE_STATS") != NULL) {
+        sc_stats_dump(stderr);
+    }
+}
+
+// ingest csv|bin [path|-] [batch_size] [csv|jsonl|bin]: streams a file through
+// the batch pipeline, optionally writing the results to stdout (the summary
+// then goes to stderr)
+static int ingest_main(int argc, char** argv) {
+    int binary = argc > 0 && strcmp(argv[0], "bin") == 0;
+    const char* const out_formats[] = { "csv", "jsonl", "bin" };
+    int out_format = -1;
+    for (int f = 0; argc > 3 && f < 3; f++) {
+        out_format = strcmp(argv[3], out_formats[f]) == 0 ? f : out_format;
+    }
+    if (argc < 1 || (!binary && strcmp(argv[0], "csv") != 0) || (argc > 3 && out_format < 0)) {
+        fprintf(stderr, "Usage: triangle_agents ingest csv|bin [path|-] [batch_size] [csv|jsonl|bin]\n");
+        return EXIT_FAILURE;
+    }
+    int fd = argc < 2 || strcmp(argv[1], "-") == 0 ? STDIN_FILENO : open(argv[1], O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Cannot open %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+    size_t batch_size = argc > 2 ? strtoull(argv[2], NULL, 10) : 64 * 1024;
+
+    triangle_domain_init();
+    sc_log_set_level(SC_LOG_LEVEL_WARN);
+    cli_stats_start();
+    sc_memory_context ctx;
+    sc_memory_init(&ctx, 10);
+    sc_thread_pool pool;
+    sc_thread_pool_init(&pool, 0);
+    triangle_ingest_pipeline pipeline = { &ctx, &pool, 0, 0, NULL, out_format, { 0 } };
+    sc_out out;
+    if (out_format >= 0) {
+        sc_out_init(&out, STDOUT_FILENO, SC_OUT_DEFAULT_CAPACITY);
+        triangle_out_header(&out, out_format);
+        pipeline.out = &out;
+    }
+    triangle_ingest_stats stats;
+    sc_result result = (binary ? triangle_ingest_binary : triangle_ingest_csv)(fd, batch_size,
+                                                                             triangle_ingest_pipeline_push,
+                                                                             &pipeline, &stats);
+    if (out_format >= 0 && sc_out_destroy(&out) != SC_RESULT_OK) {
+        fprintf(stderr, "Cannot write results\n");
+        result = SC_RESULT_ERROR;
+    }
+    sc_thread_pool_destroy(&pool);
+    sc_memory_destroy(&ctx);
+    cli_stats_finish();
+    if (fd != STDIN_FILENO) {
+        close(fd);
+    }
+
+    FILE* summary = out_format >= 0 ? stderr : stdout;
+    fprintf(summary, "Ingested %zu triangles in %zu batches: %zu right-angled, %zu batches incomplete, %zu rejected",
+            stats.triangles, stats.batches, pipeline.right, pipeline.failed_batches, stats.rejected);
+    if (stats.rejected > 0) {
+        fprintf(summary, " (first at %s %zu)", binary ? "record" : "line", stats.first_rejected);
+    }
+    triangle_ingest_pipeline_print_failures(summary, &pipeline);
+    fprintf(summary, "\n");
+    return result == SC_RESULT_OK ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// pack csv|bin path|- out [batch_size]: converts a file to the mapped batch format
+static int pack_main(int argc, char** argv) {
+    int binary = argc > 0 && strcmp(argv[0], "bin") == 0;
+    if (argc < 3 || (!binary && strcmp(argv[0], "csv") != 0)) {
+        fprintf(stderr, "Usage: triangle_agents pack csv|bin path|- out [batch_size]\n");
+        return EXIT_FAILURE;
+    }
+    int in = strcmp(argv[1], "-") == 0 ? STDIN_FILENO : open(argv[1], O_RDONLY);
+    if (in < 0) {
+        fprintf(stderr, "Cannot open %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+    triangle_batch_file_writer writer = { open(argv[2], O_WRONLY | O_CREAT | O_TRUNC, 0644), 0, SC_RESULT_OK };
+    if (writer.fd < 0) {
+        fprintf(stderr, "Cannot open %s\n", argv[2]);
+        return EXIT_FAILURE;
+    }
+    size_t batch_size = argc > 3 ? strtoull(argv[3], NULL, 10) : 64 * 1024;
+
+    triangle_domain_init();
+    triangle_ingest_stats stats;
+    sc_result result = (binary ? triangle_ingest_binary : triangle_ingest_csv)(in, batch_size,
+                                                                             triangle_batch_file_append_fn, &writer,
+                                                                             &stats);
+    if (close(writer.fd) != 0 || writer.result != SC_RESULT_OK) {
+        fprintf(stderr, "Cannot write %s\n", argv[2]);
+        result = SC_RESULT_ERROR;
+    }
+    if (in != STDIN_FILENO) {
+        close(in);
+    }
+    printf("Packed %zu triangles into %zu frames, %zu rejected\n", stats.triangles, writer.frames, stats.rejected);
+    return result == SC_RESULT_OK ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// map path [writeback]: runs every frame of a batch file through the pipeline in place
+static int map_main(int argc, char** argv) {
+    if (argc < 1) {
+        fprintf(stderr, "Usage: triangle_agents map path [writeback]\n");
+        return EXIT_FAILURE;
+    }
+    triangle_batch_file file;
+    if (triangle_batch_file_map(&file, argv[0], argc > 1 && strcmp(argv[1], "writeback") == 0) != SC_RESULT_OK) {
+        return EXIT_FAILURE;
+    }
+
+    triangle_domain_init();
+    sc_log_set_level(SC_LOG_LEVEL_WARN);
+    cli_stats_start();
+    sc_memory_context ctx;
+    sc_memory_init(&ctx, 10);
+    sc_thread_pool pool;
+    sc_thread_pool_init(&pool, 0);
+    triangle_ingest_pipeline pipeline = { &ctx, &pool, 0, 0, NULL, 0, { 0 } };
+    size_t frames = 0;
+    size_t triangles = 0;
+    triangle_batch batch;
+    int status;
+    while ((status = triangle_batch_file_next(&file, &batch)) == 1) {
+        triangle_ingest_pipeline_push(&pipeline, &batch);
+        frames++;
+        triangles += batch.count;
+    }
+    sc_thread_pool_destroy(&pool);
+    sc_memory_destroy(&ctx);
+    triangle_batch_file_unmap(&file);
+    cli_stats_finish();
+
+    printf("Mapped %zu triangles in %zu frames: %zu right-angled, %zu frames incomplete", triangles, frames,
+           pipeline.right, pipeline.failed_batches);
+    triangle_ingest_pipeline_print_failures(stdout, &pipeline);
+    printf("\n");
+    if (status < 0) {
+        fprintf(stderr, "Corrupt frame after %zu frames in %s\n", frames, argv[0]);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+// gen csv|bin|tbat|agents|batch count [seed=N two=F none=F right=F dup=F recurring=N batch=N]:
+// writes a synthetic stream to stdout in an ingest (or batch file) format, or
+// feeds it to the single-triangle agents or the batch pipeline
+static int gen_main(int argc, char** argv) {
+    static const char* const modes[] = { "csv", "bin", "tbat", "agents", "batch" };
+    int mode = -1;
+    for (int m = 0; argc > 0 && m < 5; m++) {
+        mode = strcmp(argv[0], modes[m]) == 0 ? m : mode;
+    }
+    triangle_gen_config config = triangle_gen_defaults;
+    size_t batch_size = 64 * 1024;
+    int usage = mode < 0 || argc < 2;
+    for (int a = 2; a < argc && !usage; a++) {
+        char* value = strchr(argv[a], '=');
+        usage = value == NULL;
+        if (usage) {
+            break;
+        }
+        size_t key_len = (size_t)(value++ - argv[a]);
+        if (strncmp(argv[a], "seed", key_len) == 0 && key_len == 4) {
+            config.seed = strtoull(value, NULL, 10);
+        } else if (strncmp(argv[a], "two", key_len) == 0 && key_len == 3) {
+            config.two_unknown = strtod(value, NULL);
+        } else if (strncmp(argv[a], "none", key_len) == 0 && key_len == 4) {
+            config.none_unknown = strtod(value, NULL);
+        } else if (strncmp(argv[a], "right", key_len) == 0 && key_len == 5) {
+            config.right = strtod(value, NULL);
+        } else if (strncmp(argv[a], "dup", key_len) == 0 && key_len == 3) {
+            config.duplicate = strtod(value, NULL);
+        } else if (strncmp(argv[a], "recurring", key_len) == 0 && key_len == 9) {
+            config.recurring = strtoull(value, NULL, 10);
+        } else if (strncmp(argv[a], "batch", key_len) == 0 && key_len == 5) {
+            batch_size = strtoull(value, NULL, 10);
+        } else {
+            usage = 1;
+        }
+    }
+    if (usage || batch_size == 0 || config.two_unknown + config.none_unknown > 1.0) {
+        fprintf(stderr, "Usage: triangle_agents gen csv|bin|tbat|agents|batch count "
+                        "[seed=N two=F none=F right=F dup=F recurring=N batch=N]\n");
+        return EXIT_FAILURE;
+    }
+    size_t count = strtoull(argv[1], NULL, 10);
+
+    triangle_domain_init();
+    sc_log_set_level(SC_LOG_LEVEL_ERROR); // invalid triangles are part of the workload
+    cli_stats_start();
+    triangle_gen gen;
+    triangle_gen_init(&gen, &config);
+    sc_result result = SC_RESULT_OK;
+    if (mode == 3) {
+        sc_memory_context ctx;
+        sc_memory_init(&ctx, 10);
+        int rules = 0;
+        sc_memory_store(&ctx, "rules_set", &rules, "rules_set");
+        size_t right = 0, failed = 0;
+        for (size_t j = 0; j < count; j++) {
+            triangle tri;
+            triangle_gen_next(&gen, &tri);
+            sc_memory_store(&ctx, "input_triangle", &tri, "triangle");
+            if (triangle_processing_agent_execute(&ctx) != SC_RESULT_OK) {
+                failed++;
+                continue;
+            }
+            int* is_right = sc_memory_get(&ctx, "is_right_triangle", "int");
+            right += is_right != NULL && *is_right;
+        }
+        sc_memory_destroy(&ctx);
+        printf("Generated %zu triangles: %zu right-angled, %zu failed\n", count, right, failed);
+    } else if (mode == 4) {
+        sc_memory_context ctx;
+        sc_memory_init(&ctx, 10);
+        sc_thread_pool pool;
+        sc_thread_pool_init(&pool, 0);
+        triangle_ingest_pipeline pipeline = { &ctx, &pool, 0, 0, NULL, 0, { 0 } };
+        result = triangle_gen_batches(&gen, count, batch_size, triangle_ingest_pipeline_push, &pipeline);
+        sc_thread_pool_destroy(&pool);
+        sc_memory_destroy(&ctx);
+        printf("Generated %zu triangles: %zu right-angled, %zu batches incomplete", count, pipeline.right,
+               pipeline.failed_batches);
+        triangle_ingest_pipeline_print_failures(stdout, &pipeline);
+        printf("\n");
+    } else if (mode == 2) {
+        triangle_batch_file_writer writer = { STDOUT_FILENO, 0, SC_RESULT_OK };
+        result = triangle_gen_batches(&gen, count, batch_size, triangle_batch_file_append_fn, &writer);
+    } else {
+        // Unprocessed input, so the right column of CSV (mask bit 3 of binary) is 0
+        sc_out out;
+        sc_out_init(&out, STDOUT_FILENO, SC_OUT_DEFAULT_CAPACITY);
+        for (size_t j = 0; j < count; j++) {
+            triangle tri;
+            triangle_gen_next(&gen, &tri);
+            triangle_out_write(&out, mode == 0 ? TRIANGLE_OUT_CSV : TRIANGLE_OUT_BINARY, &tri, 0);
+        }
+        result = sc_out_destroy(&out);
+    }
+    triangle_gen_destroy(&gen);
+    cli_stats_finish();
+    if (result != SC_RESULT_OK) {
+        fprintf(stderr, "Cannot write generated triangles\n");
+    }
+    return result == SC_RESULT_OK ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// bench [max_entries] [repeats]: microbenchmarks as JSON lines on stdout
+static int bench_main(int argc, char** argv) {
+    size_t max_entries = argc > 0 ? strtoull(argv[0], NULL, 10) : 1000000;
+    unsigned repeats = argc > 1 ? (unsigned)strtoul(argv[1], NULL, 10) : 5;
+    if (max_entries < 10 || repeats == 0) {
+        fprintf(stderr, "Usage: triangle_agents bench [max_entries >= 10] [repeats >= 1]\n");
+        return EXIT_FAILURE;
+    }
+    triangle_domain_init();
+    sc_bench_all(max_entries, repeats);
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1 && strcmp(argv[1], "ingest") == 0) {
+        return ingest_main(argc - 2, argv + 2);
+    }
+    if (argc > 1 && strcmp(argv[1], "pack") == 0) {
+        return pack_main(argc - 2, argv + 2);
+    }
+    if (argc > 1 && strcmp(argv[1], "map") == 0) {
+        return map_main(argc - 2, argv + 2);
+    }
+    if (argc > 1 && strcmp(argv[1], "gen") == 0) {
+        return gen_main(argc - 2, argv + 2);
+    }
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        return bench_main(argc - 2, argv + 2);
+    }
+    if (argc > 1 && strcmp(argv[1], "selftest") == 0) {
+        triangle_domain_init();
+        int ok = triangle_batch_kernels_selftest();
+        ok &= triangle_batch_parallel_selftest();
+        ok &= sc_concurrent_memory_selftest();
+        ok &= sc_event_selftest();
+        ok &= sc_log_selftest();
+        ok &= sc_snapshot_selftest();
+        ok &= sc_wal_selftest();
+        ok &= triangle_ingest_selftest();
+        ok &= triangle_batch_file_selftest();
+        ok &= triangle_out_selftest();
+        ok &= triangle_gen_selftest();
+        ok &= sc_stats_selftest();
+        ok &= triangle_agents_selftest();
+        return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // Initialize SC memory; the smoke test shows the per-triangle debug events too
+    triangle_domain_init();
+    sc_log_set_level(SC_LOG_LEVEL_DEBUG);
     sc_memory_context ctx;
     sc_memory_init(&ctx, 10);
 
@@ -205,14 +6296,61 @@ int main() {
     result = triangle_processing_agent_execute(&ctx);
     
     print_sc_memory(&ctx);
-    printf("Result: %s\n", result == SC_RESULT_OK ? "SC_RESULT_OK" : "SC_RESULT_ERROR");
+    printf("Result: %s\n\n", result == SC_RESULT_OK ? "SC_RESULT_OK" : "SC_RESULT_ERROR");
 
-    // Free memory
-    for (size_t i = 0; i < ctx.size; i++) {
-        free(ctx.entries[i].addr);
-        free(ctx.entries[i].type);
+    // Test batch (both triangles above plus 30°, ?, 60°)
+    triangle triangle3 = {
+        { {30.0, 1}, {0.0, 0}, {60.0, 1} }
+    };
+    triangle_batch batch;
+    triangle_batch_init(&batch, 3);
+    triangle_batch_push(&batch, &triangle1);
+    triangle_batch_push(&batch, &triangle2);
+    triangle_batch_push(&batch, &triangle3);
+    sc_memory_store(&ctx, "input_triangle_batch", &batch, "triangle_batch");
+
+    printf("=== Test 3: Triangle batch ===\n");
+    sc_thread_pool pool;
+    sc_thread_pool_init(&pool, 2);
+    result = triangle_processing_batch_agent_execute(&ctx, &pool);
+    sc_thread_pool_destroy(&pool);
+    for (size_t j = 0; j < batch.count; j++) {
+        triangle tri;
+        triangle_batch_get(&batch, j, &tri);
+        int is_right = (int)((batch.is_right[j / TRIANGLE_BATCH_LANES] >> (j % TRIANGLE_BATCH_LANES)) & 1);
+        printf("%20zu: Triangle(%.2f %.2f %.2f ) %s\n", j, tri.angles[0].value, tri.angles[1].value,
+               tri.angles[2].value, is_right ? "true" : "false");
     }
-    free(ctx.entries);
+    printf("Result: %s\n\n", result == SC_RESULT_OK ? "SC_RESULT_OK" : "SC_RESULT_ERROR");
+
+    // Test triangle 4 (45°, ?, 45°) through store-triggered agents
+    triangle triangle4 = {
+        { {45.0, 1}, {0.0, 0}, {45.0, 1} }
+    };
+    triangle_agents_subscribe(&ctx);
+    sc_memory_store(&ctx, "input_triangle", &triangle4, "triangle");
+
+    printf("=== Test 4: Event-driven agents ===\n");
+    size_t failed = 0;
+    size_t activations = sc_event_dispatch(&ctx, &failed);
+    print_sc_memory(&ctx);
+    printf("Activations: %zu, failed: %zu\n\n", activations, failed);
+
+    // Test triangle 1 again: both agents answer from the memo cache
+    sc_memory_store(&ctx, "input_triangle", &triangle1, "triangle");
+
+    printf("=== Test 5: Memoized triangle ===\n");
+    activations = sc_event_dispatch(&ctx, &failed);
+    print_sc_memory(&ctx);
+    uint64_t memo_hits, memo_misses;
+    triangle_memo_stats(&memo_hits, &memo_misses);
+    printf("Activations: %zu, failed: %zu, memo hits: %llu, misses: %llu\n", activations, failed,
+           (unsigned long long)memo_hits, (unsigned long long)memo_misses);
+
+    // Free memory
+    triangle_batch_destroy(&batch);
+    sc_memory_destroy(&ctx);
+    triangle_memo_configure(0);
 
     return 0;
 }